@@ -7,9 +7,21 @@
 #include "OptionParser.h"
 
 #include <cstdlib>
+#include <cstring>
 #include <algorithm>
 #include <complex>
+#include <cmath>
 #include <ciso646>
+#include <fstream>
+#include <sys/stat.h>
+#if __cplusplus >= 201103L
+# include <thread>
+#endif
+#ifndef _WIN32
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <unistd.h>
+#endif
 
 #if defined(ENABLE_NLS) && ENABLE_NLS
 # include <libintl.h>
@@ -18,6 +30,12 @@
 # define _(s) ((const char *) (s))
 #endif
 
+#ifdef _WIN32
+# define environ _environ
+#else
+extern char** environ;
+#endif
+
 using namespace std;
 
 namespace optparse {
@@ -44,15 +62,18 @@ template<class InputIterator>
 static string str_join(const string& sep, InputIterator begin, InputIterator end) {
   return str_join_trans(sep, begin, end, str_wrap(""));
 }
+// builds a new string, replacing in place would move the tail every time
 static string& str_replace(string& s, const string& patt, const string& repl) {
-  size_t pos = 0, n = patt.length();
-  while (true) {
-    pos = s.find(patt, pos);
-    if (pos == string::npos)
-      break;
-    s.replace(pos, n, repl);
-    pos += repl.size();
+  size_t pos = s.find(patt), last = 0, n = patt.length();
+  if (pos == string::npos)
+    return s;
+  string r;
+  for (; pos != string::npos; pos = s.find(patt, last)) {
+    r.append(s, last, pos - last).append(repl);
+    last = pos + n;
   }
+  r.append(s, last, string::npos);
+  s.swap(r);
   return s;
 }
 static string str_replace(const string& s, const string& patt, const string& repl) {
@@ -94,6 +115,23 @@ static string str_format(const string& str, size_t pre, size_t len, bool running
   ss << p << s.substr(linestart) << endl;
   return ss.str();
 }
+static bool is_blank(char c) {
+  return c == ' ' or c == '\t' or c == '\r';
+}
+static string str_trim(const char* begin, const char* end) {
+  while (begin != end and is_blank(*begin))
+    ++begin;
+  while (end != begin and is_blank(end[-1]))
+    --end;
+  return string(begin, end);
+}
+static string static_dest(const StaticOption& s) {
+  if (s.dest)
+    return s.dest;
+  if (s.long_opt)
+    return str_replace(s.long_opt, "-", "_");
+  return string(1, s.short_opt);
+}
 static string str_inc(const string& s) {
   stringstream ss;
   string v = (s != "") ? s : "0";
@@ -125,8 +163,286 @@ static string basename(const string& s) {
     b.erase(0, i+1);
   return b;
 }
+static size_t edit_distance(const string& a, const string& b) {
+  vector<size_t> row(b.size() + 1);
+  for (size_t j = 0; j <= b.size(); ++j)
+    row[j] = j;
+  for (size_t i = 1; i <= a.size(); ++i) {
+    size_t diag = row[0];
+    row[0] = i;
+    for (size_t j = 1; j <= b.size(); ++j) {
+      size_t up = row[j];
+      row[j] = min(min(row[j] + 1, row[j-1] + 1), diag + (a[i-1] != b[j-1]));
+      diag = up;
+    }
+  }
+  return row[b.size()];
+}
+// how many typos are tolerated when suggesting a replacement for s
+static size_t suggest_distance(const string& s) {
+  return max<size_t>(1, min<size_t>(3, s.length() / 3));
+}
 ////////// } auxiliary (string) functions //////////
 
+////////// auxiliary (binary) functions { //////////
+// little-endian, independent of host byte order and alignment
+static void put_u32(string& buf, unsigned int v) {
+  for (int i = 0; i < 4; ++i)
+    buf += static_cast<char>((v >> (8*i)) & 0xff);
+}
+static void set_u32(string& buf, size_t pos, unsigned int v) {
+  for (int i = 0; i < 4; ++i)
+    buf[pos+i] = static_cast<char>((v >> (8*i)) & 0xff);
+}
+static unsigned int get_u32(const char* p) {
+  const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+  return u[0] | (u[1] << 8) | (u[2] << 16) | (static_cast<unsigned int>(u[3]) << 24);
+}
+static unsigned int put_str(string& buf, const string& s) {
+  unsigned int off = buf.size();
+  put_u32(buf, s.size());
+  buf += s;
+  buf += '\0';
+  return off;
+}
+// IEEE 754 doubles as two u32, the low word first
+static bool host_little_endian() {
+  const unsigned int one = 1;
+  return *reinterpret_cast<const unsigned char*>(&one) == 1;
+}
+static void put_f64(string& buf, double d) {
+  unsigned char b[8];
+  memcpy(b, &d, 8);
+  const bool little = host_little_endian();
+  for (int i = 0; i < 8; ++i)
+    buf += static_cast<char>(b[little ? i : 7 - i]);
+}
+static double get_f64(const char* p) {
+  unsigned char b[8];
+  const bool little = host_little_endian();
+  for (int i = 0; i < 8; ++i)
+    b[little ? i : 7 - i] = static_cast<unsigned char>(p[i]);
+  double d;
+  memcpy(&d, b, 8);
+  return d;
+}
+// the strings, followed by the array of their offsets, which is returned
+template<typename InputIterator>
+static unsigned int put_str_list(string& buf, InputIterator begin, InputIterator end) {
+  vector<unsigned int> offs;
+  for (; begin != end; ++begin)
+    offs.push_back(put_str(buf, *begin));
+  unsigned int off = buf.size();
+  for (vector<unsigned int>::const_iterator it = offs.begin(); it != offs.end(); ++it)
+    put_u32(buf, *it);
+  return off;
+}
+// FNV-1a over 32-bit words, a quarter of the steps of fnv1a() for large blobs
+static unsigned int checksum(const char* p, size_t n) {
+  unsigned int h = 2166136261u;
+  size_t i = 0;
+  for (; n - i >= 4; i += 4)
+    h = ((h ^ get_u32(p + i)) * 16777619u) & 0xffffffffu;
+  for (; i < n; ++i)
+    h = ((h ^ static_cast<unsigned char>(p[i])) * 16777619u) & 0xffffffffu;
+  return h;
+}
+// random access to put_u32/put_str data, out of range reads give 0 and ""
+class blob_view {
+public:
+  blob_view(const char* p, size_t n) : data(p), size(n) {}
+  unsigned int u32(size_t off) const {
+    return (off < size and size - off >= 4) ? get_u32(data + off) : 0;
+  }
+  const char* str(size_t off) const {
+    if (off >= size or size - off <= 4)
+      return "";
+    size_t len = get_u32(data + off);
+    if (len >= size - off - 4 or data[off + 4 + len] != '\0')
+      return "";
+    return data + off + 4;
+  }
+  // whether n items of item_size bytes start at off
+  bool fits(size_t off, size_t n, size_t item_size) const {
+    return off <= size and n <= (size - off) / item_size;
+  }
+  const char* data;
+  size_t size;
+};
+
+// Layout of schema blobs (all integers u32, see put_u32):
+//   header:      "OPTS" version size checksum
+//   settings:    usage version prog epilog env_prefix flags default_count defaults container_count containers
+//                positional_count positionals
+//   defaults:    default_count * (dest value)
+//   positionals: positional_count * (name dest type min max choice_count choices), max 0xffffffff is
+//                Positional::UNLIMITED
+//   containers:  container_count * (title description option_count options long_count long_index short_index
+//                env_count)
+//   options:     option_count * (short_count shorts long_count longs action type dest default nargs const
+//                choice_count choices help metavar env)
+//   long index:  long_count * (name option), sorted by name
+//   short index: 256 * (option + 1), 0 if there is none
+//   strings:     length, bytes, '\0'
+// The first container is the parser itself. Names are stored without
+// dashes, lists of names and choices are arrays of string offsets.
+static const size_t schema_header = 16;
+enum { cfg_usage, cfg_version, cfg_prog, cfg_epilog, cfg_env_prefix, cfg_flags, cfg_default_count, cfg_defaults,
+  cfg_container_count, cfg_containers, cfg_positional_count, cfg_positionals, cfg_fields };
+enum { arg_name, arg_dest, arg_type, arg_min, arg_max, arg_choice_count, arg_choices, arg_fields };
+enum { con_title, con_description, con_option_count, con_options, con_long_count, con_long_index,
+  con_short_index, con_env_count, con_fields };
+enum { rec_short_count, rec_shorts, rec_long_count, rec_longs, rec_action, rec_type, rec_dest, rec_default,
+  rec_nargs, rec_const, rec_choice_count, rec_choices, rec_help, rec_metavar, rec_env, rec_fields };
+static const size_t schema_container = 4 * con_fields;
+static const size_t schema_record = 4 * rec_fields;
+static const size_t schema_positional = 4 * arg_fields;
+static const size_t schema_shorts = 256;
+////////// } auxiliary (binary) functions //////////
+
+
+////////// unit types { //////////
+struct unit {
+  const char* suffix;
+  double factor;
+};
+static const unit size_units[] = {
+  { "", 1 }, { "B", 1 },
+  { "K", 1024.0 }, { "M", 1048576.0 }, { "G", 1073741824.0 }, { "T", 1099511627776.0 }, { "P", 1125899906842624.0 },
+  { "KiB", 1024.0 }, { "MiB", 1048576.0 }, { "GiB", 1073741824.0 }, { "TiB", 1099511627776.0 }, { "PiB", 1125899906842624.0 },
+  { "kB", 1e3 }, { "KB", 1e3 }, { "MB", 1e6 }, { "GB", 1e9 }, { "TB", 1e12 }, { "PB", 1e15 },
+  { 0, 0 }
+};
+static const unit duration_units[] = {
+  { "ns", 1e-9 }, { "us", 1e-6 }, { "ms", 1e-3 }, { "s", 1 }, { "m", 60 }, { "min", 60 }, { "h", 3600 }, { "d", 86400 },
+  { 0, 0 }
+};
+static bool unit_factor(const unit* units, const string& suffix, double& factor) {
+  for (; units->suffix; ++units) {
+    if (suffix == units->suffix) {
+      factor = units->factor;
+      return true;
+    }
+  }
+  return false;
+}
+// unsigned decimal number without exponent, starting at s[pos]
+static bool parse_decimal(const string& s, size_t& pos, double& result) {
+  size_t start = pos, digits = 0;
+  for (; pos < s.size() and isdigit(static_cast<unsigned char>(s[pos])); ++pos)
+    digits++;
+  if (pos < s.size() and s[pos] == '.')
+    for (++pos; pos < s.size() and isdigit(static_cast<unsigned char>(s[pos])); ++pos)
+      digits++;
+  if (digits == 0 or not (istringstream(s.substr(start, pos - start)) >> result)) {
+    pos = start;
+    return false;
+  }
+  return true;
+}
+
+//! Bytes, e.g. 512, 4K, 64MiB, 1.5GB (K, M, ... and KiB, MiB, ... are binary)
+class SizeType : public UnitType {
+public:
+  bool operator() (const string& val, double& result) const {
+    size_t pos = 0;
+    double n, factor;
+    if (not parse_decimal(val, pos, n) or not unit_factor(size_units, val.substr(pos), factor))
+      return false;
+    result = n * factor;
+    return result == floor(result);
+  }
+};
+//! Seconds, e.g. 30, 250ms, 1h30m
+class DurationType : public UnitType {
+public:
+  bool operator() (const string& val, double& result) const {
+    size_t pos = 0;
+    double n, factor;
+    if (parse_decimal(val, pos, n) and pos == val.size()) {
+      result = n;
+      return true;
+    }
+    pos = 0;
+    result = 0;
+    while (pos < val.size()) {
+      if (not parse_decimal(val, pos, n))
+        return false;
+      size_t start = pos;
+      while (pos < val.size() and isalpha(static_cast<unsigned char>(val[pos])))
+        pos++;
+      if (not unit_factor(duration_units, val.substr(start, pos - start), factor))
+        return false;
+      result += n * factor;
+    }
+    return val != "";
+  }
+};
+//! Ratio, e.g. 0.25 or 25%
+class PercentType : public UnitType {
+public:
+  bool operator() (const string& val, double& result) const {
+    size_t pos = (val != "" and (val[0] == '-' or val[0] == '+')) ? 1 : 0;
+    double n;
+    if (not parse_decimal(val, pos, n))
+      return false;
+    if (val[0] == '-')
+      n = -n;
+    if (pos == val.size())
+      result = n;
+    else if (pos + 1 == val.size() and val[pos] == '%')
+      result = n / 100;
+    else
+      return false;
+    return true;
+  }
+};
+////////// } unit types //////////
+
+////////// class BKTree { //////////
+void BKTree::insert(const string& w) {
+  if (_nodes.empty()) {
+    _nodes.push_back(Node(w));
+    return;
+  }
+  size_t cur = 0;
+  while (true) {
+    size_t d = edit_distance(w, _nodes[cur].word);
+    if (d == 0)
+      return;
+    map<size_t,size_t>::const_iterator it = _nodes[cur].children.find(d);
+    if (it == _nodes[cur].children.end()) {
+      _nodes[cur].children[d] = _nodes.size();
+      _nodes.push_back(Node(w));
+      return;
+    }
+    cur = it->second;
+  }
+}
+
+string BKTree::closest(const string& w, size_t max_dist) const {
+  string best;
+  size_t best_dist = max_dist + 1;
+  vector<size_t> todo;
+  if (not _nodes.empty())
+    todo.push_back(0);
+  while (not todo.empty()) {
+    const Node& node = _nodes[todo.back()];
+    todo.pop_back();
+    size_t d = edit_distance(w, node.word);
+    if (d < best_dist or (d == best_dist and node.word < best)) {
+      best = node.word;
+      best_dist = d;
+    }
+    // triangle inequality: only subtrees at distance d +- best_dist can be closer
+    size_t r = min(best_dist, max_dist);
+    map<size_t,size_t>::const_iterator it = node.children.lower_bound(d > r ? d - r : 0);
+    for (; it != node.children.end() and it->first <= d + r; ++it)
+      todo.push_back(it->second);
+  }
+  return (best_dist <= max_dist) ? best : "";
+}
+////////// } class BKTree //////////
 
 ////////// class OptionContainer { //////////
 Option& OptionContainer::add_option(const string& opt) {
@@ -142,8 +458,11 @@ Option& OptionContainer::add_option(const string& opt1, const string& opt2, cons
   return add_option(vector<string>(&tmp[0], &tmp[3]));
 }
 Option& OptionContainer::add_option(const vector<string>& v) {
+  if (_frozen)
+    throw "option group already added to a parser";
   _opts.resize(_opts.size()+1, Option(get_parser()));
   Option& option = _opts.back();
+  _generation++;
   string dest_fallback;
   for (vector<string>::const_iterator it = v.begin(); it != v.end(); ++it) {
     if (it->substr(0,2) == "--") {
@@ -165,6 +484,9 @@ Option& OptionContainer::add_option(const vector<string>& v) {
   return option;
 }
 string OptionContainer::format_option_help(unsigned int indent /* = 2 */) const {
+  return format_option_help(0, indent);
+}
+string OptionContainer::format_option_help(const OptionParser* parser, unsigned int indent) const {
   stringstream ss;
 
   if (_opts.empty())
@@ -172,85 +494,287 @@ string OptionContainer::format_option_help(unsigned int indent /* = 2 */) const
 
   for (list<Option>::const_iterator it = _opts.begin(); it != _opts.end(); ++it) {
     if (it->help() != SUPPRESS_HELP)
-      ss << it->format_help(indent);
+      ss << it->format_help(parser, indent);
   }
 
   return ss.str();
 }
 ////////// } class OptionContainer //////////
 
+////////// struct OptionParser::OptionTable { //////////
+const char* OptionParser::OptionTable::long_name(size_t k) const {
+  if (options)
+    return options[by_long[k]].long_opt;
+  const blob_view in(blob, blob_size);
+  return in.str(in.u32(long_index + 8*k));
+}
+size_t OptionParser::OptionTable::long_option(size_t k) const {
+  if (options)
+    return by_long[k];
+  return blob_view(blob, blob_size).u32(long_index + 8*k + 4);
+}
+size_t OptionParser::OptionTable::short_option(unsigned char c) const {
+  if (options)
+    return (c < 128) ? by_short[c] : size;
+  size_t i = blob_view(blob, blob_size).u32(short_index + 4*c);
+  return i ? i - 1 : size;
+}
+// position of the first long name not less than opt
+size_t OptionParser::OptionTable::find_long(const string& opt) const {
+  size_t lo = 0, hi = long_count;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (opt.compare(long_name(mid)) > 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+string OptionParser::OptionTable::dest(size_t i) const {
+  if (options)
+    return static_dest(options[i]);
+  const blob_view in(blob, blob_size);
+  return in.str(in.u32(records + i * schema_record + 4*rec_dest));
+}
+const char* OptionParser::OptionTable::type(size_t i) const {
+  if (options)
+    return options[i].type ? options[i].type : "string";
+  const blob_view in(blob, blob_size);
+  return in.str(in.u32(records + i * schema_record + 4*rec_type));
+}
+const char* OptionParser::OptionTable::default_value(size_t i) const {
+  if (options)
+    return options[i].default_value ? options[i].default_value : "";
+  const blob_view in(blob, blob_size);
+  return in.str(in.u32(records + i * schema_record + 4*rec_default));
+}
+////////// } struct OptionParser::OptionTable //////////
+
 ////////// class OptionParser { //////////
 OptionParser::OptionParser() :
   OptionContainer(),
   _usage(_("%prog [options]")),
   _add_help_option(true),
   _add_version_option(true),
-  _interspersed_args(true) {}
+  _interspersed_args(true),
+  _suggest_on_error(false),
+  _args_sink(0),
+  _arena(0),
+  _config_files(),
+  _long_index(), _long_index_generation(0),
+  _env_bound(), _env_bound_generation(0), _env_bound_prefix(),
+  _tables(), _table_opts(),
+  _argv_next(0), _argv_end(0),
+  _args_next(0), _args_end(0),
+  _uncacheable(false) {}
+
+// the old results are destroyed while their arena is still alive
+OptionParser& OptionParser::arena(Arena* a) {
+  Values().swap(_values);
+  _arena = a;
+  return *this;
+}
 
+// the lookup tables of the group are used directly, not copied
 OptionParser& OptionParser::add_option_group(const OptionGroup& group) {
-  for (list<Option>::const_iterator oit = group._opts.begin(); oit != group._opts.end(); ++oit) {
-    const Option& option = *oit;
-    for (set<string>::const_iterator it = option._short_opts.begin(); it != option._short_opts.end(); ++it)
-      _optmap_s[*it] = &option;
-    for (set<string>::const_iterator it = option._long_opts.begin(); it != option._long_opts.end(); ++it)
-      _optmap_l[*it] = &option;
-  }
   _groups.push_back(&group);
+  group._frozen = true;
+  _generation++;
   return *this;
 }
 
 const Option& OptionParser::lookup_short_opt(const string& opt) const {
+  for (list<OptionTable>::const_iterator t = _tables.begin(); t != _tables.end() and opt.length() == 1; ++t) {
+    size_t i = t->short_option(static_cast<unsigned char>(opt[0]));
+    if (i < t->size)
+      return table_option(*t, i);
+  }
   optMap::const_iterator it = _optmap_s.find(opt);
-  if (it == _optmap_s.end())
-    error(_("no such option") + string(": -") + opt);
+  if (it != _optmap_s.end())
+    return *it->second;
+  for (list<OptionGroup const*>::const_iterator g = _groups.begin(); g != _groups.end(); ++g) {
+    it = (*g)->_optmap_s.find(opt);
+    if (it != (*g)->_optmap_s.end())
+      return *it->second;
+  }
+  error(_("no such option") + string(": -") + opt);
   return *it->second;
 }
 
-void OptionParser::handle_short_opt(const string& opt, const string& arg) {
-
-  _remaining.pop_front();
-  string value;
-
-  const Option& option = lookup_short_opt(opt);
-  if (option._nargs == 1) {
-    value = arg.substr(2);
-    if (value == "") {
-      if (_remaining.empty())
-        error("-" + opt + " " + _("option requires 1 argument"));
-      value = _remaining.front();
-      _remaining.pop_front();
+// clustered options (-abc) are processed in place, without copying the
+// rest of the cluster for every flag
+void OptionParser::handle_short_opt(const string& arg) {
+
+  for (size_t i = 1; i < arg.length(); ++i) {
+    const string opt = arg.substr(i, 1);
+    const Option& option = lookup_short_opt(opt);
+    if (option._nargs == 1) {
+      string value = arg.substr(i + 1);
+      if (value == "") {
+        if (not has_next_arg())
+          error("-" + opt + " " + _("option requires 1 argument"));
+        value = next_arg();
+      }
+      process_opt(option, string("-") + opt, value);
+      return;
     }
-  } else {
-    if (arg.length() > 2)
-      _remaining.push_front(string("-") + arg.substr(2));
+    process_opt(option, string("-") + opt, "");
   }
-
-  process_opt(option, string("-") + opt, value);
 }
 
 const Option& OptionParser::lookup_long_opt(const string& opt) const {
 
-  list<string> matching;
-  for (optMap::const_iterator it = _optmap_l.begin(); it != _optmap_l.end(); ++it) {
-    if (it->first.compare(0, opt.length(), opt) == 0) {
-      matching.push_back(it->first);
-      if (it->first.length() == opt.length())
-        break;
-    }
+  list<optMap const*> maps(1, &_optmap_l);
+  for (list<OptionGroup const*>::const_iterator g = _groups.begin(); g != _groups.end(); ++g)
+    maps.push_back(&(*g)->_optmap_l);
+
+  // an exact match sorts before all other names starting with opt
+  map<string, Option const*> matching;
+  for (list<OptionTable>::const_iterator t = _tables.begin(); t != _tables.end(); ++t) {
+    size_t k = t->find_long(opt);
+    if (k < t->long_count and opt == t->long_name(k))
+      return table_option(*t, t->long_option(k));
+    for (; k < t->long_count and strncmp(t->long_name(k), opt.c_str(), opt.length()) == 0; ++k)
+      matching.insert(make_pair(string(t->long_name(k)), &table_option(*t, t->long_option(k))));
+  }
+  for (list<optMap const*>::const_iterator m = maps.begin(); m != maps.end(); ++m) {
+    optMap::const_iterator it = (*m)->lower_bound(opt);
+    if (it != (*m)->end() and it->first == opt)
+      return *it->second;
+    for (; it != (*m)->end() and it->first.compare(0, opt.length(), opt) == 0; ++it)
+      matching.insert(*it);
   }
   if (matching.size() > 1) {
-    string x = str_join_trans(", ", matching.begin(), matching.end(), str_wrap("--", ""));
+    list<string> names;
+    for (map<string, Option const*>::const_iterator it = matching.begin(); it != matching.end(); ++it)
+      names.push_back(it->first);
+    string x = str_join_trans(", ", names.begin(), names.end(), str_wrap("--", ""));
     error(_("ambiguous option") + string(": --") + opt + " (" + x + "?)");
   }
   if (matching.size() == 0)
-    error(_("no such option") + string(": --") + opt);
+    error(_("no such option") + string(": --") + opt + suggest_long_opt(opt));
+
+  return *matching.begin()->second;
+}
 
-  return *_optmap_l.find(matching.front())->second;
+const Option* OptionParser::find_table_long(const string& opt) const {
+  for (list<OptionTable>::const_iterator t = _tables.begin(); t != _tables.end(); ++t) {
+    size_t k = t->find_long(opt);
+    if (k < t->long_count and opt == t->long_name(k))
+      return &table_option(*t, t->long_option(k));
+  }
+  return 0;
+}
+
+// Option objects are created on first use, in the order they are used
+const Option& OptionParser::table_option(const OptionTable& t, size_t i) const {
+  if (t.cache.empty())
+    t.cache.resize(t.size, 0);
+  if (t.cache[i])
+    return *t.cache[i];
+
+  _table_opts.push_back(Option(this));
+  Option& option = _table_opts.back();
+  if (t.options) {
+    const StaticOption& s = t.options[i];
+    if (s.short_opt)
+      option._short_opts.insert(string(1, s.short_opt));
+    if (s.long_opt)
+      option._long_opts.insert(s.long_opt);
+    option.dest(static_dest(s));
+    if (s.action)
+      option.action(s.action);
+    if (s.type)
+      option.type(s.type);
+    if (s.default_value)
+      option.set_default(s.default_value);
+    if (s.help)
+      option.help(s.help);
+    if (s.metavar)
+      option.metavar(s.metavar);
+    if (s.const_value)
+      option.set_const(s.const_value);
+  } else {
+    // the attributes are set directly, the setters would change nargs
+    const blob_view in(t.blob, t.blob_size);
+    const size_t rec = t.records + i * schema_record;
+    for (size_t n = in.u32(rec + 4*rec_short_count), j = 0; j < n; ++j)
+      option._short_opts.insert(in.str(in.u32(in.u32(rec + 4*rec_shorts) + 4*j)));
+    for (size_t n = in.u32(rec + 4*rec_long_count), j = 0; j < n; ++j)
+      option._long_opts.insert(in.str(in.u32(in.u32(rec + 4*rec_longs) + 4*j)));
+    for (size_t n = in.u32(rec + 4*rec_choice_count), j = 0; j < n; ++j)
+      option._choices.push_back(in.str(in.u32(in.u32(rec + 4*rec_choices) + 4*j)));
+    option.index_choices();
+    option._action = in.str(in.u32(rec + 4*rec_action));
+    option._type = in.str(in.u32(rec + 4*rec_type));
+    option._dest = in.str(in.u32(rec + 4*rec_dest));
+    option._default = in.str(in.u32(rec + 4*rec_default));
+    option._nargs = in.u32(rec + 4*rec_nargs);
+    option._const = in.str(in.u32(rec + 4*rec_const));
+    option._help = in.str(in.u32(rec + 4*rec_help));
+    option._metavar = in.str(in.u32(rec + 4*rec_metavar));
+    option._env = in.str(in.u32(rec + 4*rec_env));
+  }
+  t.cache[i] = &option;
+  return option;
+}
+
+void OptionParser::materialize_tables() const {
+  for (list<OptionTable>::const_iterator t = _tables.begin(); t != _tables.end(); ++t)
+    for (size_t i = 0; i < t->size; ++i)
+      table_option(*t, i);
+}
+
+// in help order: the help and version options that parse() added to the
+// front, the options of tables, the rest
+void OptionParser::container_options(const OptionGroup* group, vector<Option const*>& opts) const {
+  const list<Option>& own = group ? group->_opts : _opts;
+  opts.clear();
+  list<Option>::const_iterator it = own.begin();
+  for (; not group and it != own.end() and (it->action() == "help" or it->action() == "version"); ++it)
+    opts.push_back(&*it);
+  for (list<OptionTable>::const_iterator t = _tables.begin(); t != _tables.end(); ++t)
+    for (size_t i = 0; i < t->size and t->group == group; ++i)
+      opts.push_back(&table_option(*t, i));
+  for (; it != own.end(); ++it)
+    opts.push_back(&*it);
+}
+
+// generations only grow, so their sum changes with any added option
+unsigned long OptionParser::options_generation() const {
+  unsigned long generation = _generation;
+  for (list<OptionGroup const*>::const_iterator g = _groups.begin(); g != _groups.end(); ++g)
+    generation += (*g)->_generation;
+  return generation;
+}
+
+string OptionParser::suggest_long_opt(const string& opt) const {
+  if (not suggest_on_error())
+    return "";
+  const unsigned long generation = options_generation();
+  if (_long_index_generation != generation) {
+    set<string> names;
+    for (optMap::const_iterator it = _optmap_l.begin(); it != _optmap_l.end(); ++it)
+      names.insert(it->first);
+    for (list<OptionGroup const*>::const_iterator g = _groups.begin(); g != _groups.end(); ++g)
+      for (optMap::const_iterator it = (*g)->_optmap_l.begin(); it != (*g)->_optmap_l.end(); ++it)
+        names.insert(it->first);
+    for (list<OptionTable>::const_iterator t = _tables.begin(); t != _tables.end(); ++t)
+      for (size_t k = 0; k < t->long_count; ++k)
+        names.insert(t->long_name(k));
+    _long_index = BKTree();
+    for (set<string>::const_iterator it = names.begin(); it != names.end(); ++it)
+      _long_index.insert(*it);
+    _long_index_generation = generation;
+  }
+  string match = _long_index.closest(opt, suggest_distance(opt));
+  return (match != "") ? ", " + string(_("maybe you meant")) + " --" + match + "?" : "";
 }
 
 void OptionParser::handle_long_opt(const string& optstr) {
 
-  _remaining.pop_front();
   string opt, value;
 
   size_t delim = optstr.find("=");
@@ -262,10 +786,8 @@ void OptionParser::handle_long_opt(const string& optstr) {
 
   const Option& option = lookup_long_opt(opt);
   if (option._nargs == 1 and delim == string::npos) {
-    if (not _remaining.empty()) {
-      value = _remaining.front();
-      _remaining.pop_front();
-    }
+    if (has_next_arg())
+      value = next_arg();
   }
 
   if (option._nargs == 1 and value == "")
@@ -274,70 +796,226 @@ void OptionParser::handle_long_opt(const string& optstr) {
   process_opt(option, string("--") + opt, value);
 }
 
+// arguments are read straight from argv or the vector
+bool OptionParser::has_next_arg() const {
+  return _argv_next != _argv_end or _args_next != _args_end;
+}
+string OptionParser::next_arg() {
+  if (_argv_next != _argv_end)
+    return *_argv_next++;
+  return *_args_next++;
+}
+void OptionParser::add_leftover(const string& arg) {
+  if (_args_sink) {
+    _uncacheable = true;
+    (*_args_sink)(arg, *this);
+  }
+  else
+    _leftover.push_back(arg);
+}
+
 Values& OptionParser::parse_args(const int argc, char const* const* const argv) {
   if (prog() == "")
     prog(basename(argv[0]));
-  return parse_args(&argv[1], &argv[argc]);
+  _argv_next = &argv[1];
+  _argv_end = &argv[argc];
+  _args_next = _args_end = 0;
+  return parse();
 }
 Values& OptionParser::parse_args(const vector<string>& v) {
+  _argv_next = _argv_end = 0;
+  _args_next = v.empty() ? 0 : &v[0];
+  _args_end = v.empty() ? 0 : &v[0] + v.size();
+  return parse();
+}
+Values& OptionParser::parse() {
 
-  _remaining.assign(v.begin(), v.end());
+  _uncacheable = false;
+  if (_arena)
+    Values(*_arena).swap(_values);
+  else
+    Values().swap(_values);
+  _values._parsed = true;
+  _leftover.clear();
+#if __cplusplus >= 201103L
+  // left over from a parse that ended with another error, their failures
+  // belong to that parse
+  join_async_callbacks(false);
+#endif
 
-  if (add_help_option()) {
+  // parse_args() may be called more than once (or after load_schema())
+  if (add_help_option() and _optmap_l.find("help") == _optmap_l.end() and not find_table_long("help")) {
     add_option("-h", "--help") .action("help") .help(_("show this help message and exit"));
     _opts.splice(_opts.begin(), _opts, --(_opts.end()));
   }
-  if (add_version_option() and version() != "") {
+  if (add_version_option() and version() != "" and _optmap_l.find("version") == _optmap_l.end() and
+      not find_table_long("version")) {
     add_option("--version") .action("version") .help(_("show program's version number and exit"));
     _opts.splice(_opts.begin(), _opts, --(_opts.end()));
   }
 
-  while (not _remaining.empty()) {
-    const string arg = _remaining.front();
+  while (has_next_arg()) {
+    const string arg = next_arg();
 
-    if (arg == "--") {
-      _remaining.pop_front();
+    if (arg == "--")
       break;
-    }
 
     if (arg.substr(0,2) == "--") {
       handle_long_opt(arg.substr(2));
     } else if (arg.substr(0,1) == "-" and arg.length() > 1) {
-      handle_short_opt(arg.substr(1,1), arg);
+      handle_short_opt(arg);
     } else {
-      _remaining.pop_front();
-      _leftover.push_back(arg);
+      add_leftover(arg);
       if (not interspersed_args())
         break;
     }
   }
-  while (not _remaining.empty()) {
-    const string arg = _remaining.front();
-    _remaining.pop_front();
-    _leftover.push_back(arg);
+  while (has_next_arg())
+    add_leftover(next_arg());
+
+  process_env();
+  process_config_files();
+#if __cplusplus >= 201103L
+  join_async_callbacks(true);
+#endif
+  process_positionals();
+
+  set_default_values(_opts);
+  set_table_default_values();
+  for (list<OptionGroup const*>::iterator group_it = _groups.begin(); group_it != _groups.end(); ++group_it)
+    set_default_values((*group_it)->_opts);
+
+  return _values;
+}
+
+// the result depends on the file system, not only on the arguments
+static bool checks_files(const Option& o) {
+  return o.type() == "existing_file" or o.type() == "directory";
+}
+
+void OptionParser::process_positionals() {
+  if (_positionals.empty() or _args_sink)
+    return;
+
+  size_t required = 0;
+  for (list<Positional>::const_iterator it = _positionals.begin(); it != _positionals.end(); ++it)
+    required += it->_min;
+  if (_leftover.size() < required) {
+    list<string> missing;
+    size_t avail = _leftover.size();
+    for (list<Positional>::const_iterator it = _positionals.begin(); it != _positionals.end(); ++it) {
+      if (avail < it->_min)
+        missing.push_back(it->name());
+      avail -= min(avail, it->_min);
+    }
+    error(_("the following arguments are required") + string(": ") + str_join(", ", missing.begin(), missing.end()));
   }
 
-  for (list<Option>::const_iterator it = _opts.begin(); it != _opts.end(); ++it) {
-    if (it->get_default() != "" and not _values.is_set(it->dest()))
-      _values[it->dest()] = it->get_default();
+  // earlier positionals take as many of the surplus arguments as they can
+  vector<pair<Positional const*, string const*> > items;
+  size_t extra = _leftover.size() - required;
+  list<string>::const_iterator arg = _leftover.begin();
+  for (list<Positional>::const_iterator it = _positionals.begin(); it != _positionals.end(); ++it) {
+    size_t n = min(extra, it->_max - it->_min);
+    extra -= n;
+    for (n += it->_min; n > 0; --n)
+      items.push_back(make_pair(&*it, &*arg++));
+  }
+  if (arg != _leftover.end())
+    error(_("unrecognized arguments") + string(": ") + str_join(" ", arg, list<string>::const_iterator(_leftover.end())));
+
+  for (size_t i = 0; i < items.size(); ++i) {
+    if (checks_files(items[i].first->_option))
+      _uncacheable = true;
   }
 
-  for (list<OptionGroup const*>::iterator group_it = _groups.begin(); group_it != _groups.end(); ++group_it) {
-    for (list<Option>::const_iterator it = (*group_it)->_opts.begin(); it != (*group_it)->_opts.end(); ++it) {
-      if (it->get_default() != "" and not _values.is_set(it->dest()))
-        _values[it->dest()] = it->get_default();
+  vector<string> errors(items.size());
+  vector<double> numbers(items.size());
+  size_t workers = 1;
+#if __cplusplus >= 201103L
+  // validation may stat() files, which is slow on network file systems;
+  // no more threads than cores, and each with enough arguments to check
+  const size_t min_per_worker = 64;
+  workers = min<size_t>(max(1u, thread::hardware_concurrency()), (items.size() + min_per_worker - 1) / min_per_worker);
+  if (workers > 1) {
+    vector<thread> pool;
+    for (size_t w = 0; w < workers; ++w) {
+      pool.push_back(thread([&, w] {
+        for (size_t i = w; i < items.size(); i += workers)
+          errors[i] = items[i].first->_option.check_value(*this, *items[i].second, &numbers[i]);
+      }));
     }
+    for (size_t w = 0; w < workers; ++w)
+      pool[w].join();
+  }
+#endif
+  if (workers <= 1) {
+    for (size_t i = 0; i < items.size(); ++i)
+      errors[i] = items[i].first->_option.check_value(*this, *items[i].second, &numbers[i]);
   }
 
-  return _values;
+  for (size_t i = 0; i < items.size(); ++i) {
+    if (errors[i] != "")
+      error(_("argument") + string(" ") + items[i].first->name() + ": " + errors[i]);
+  }
+  for (size_t i = 0; i < items.size(); ++i) {
+    const Positional& p = *items[i].first;
+    if (i == 0 or items[i-1].first != &p)
+      _values[p.dest()] = *items[i].second;
+    if (p._max > 1)
+      _values.all(p.dest()).push_back(*items[i].second);
+    if (unit_type(p.type()) and (i == 0 or items[i-1].first != &p))
+      _values.number(p.dest(), numbers[i]);
+    if (unit_type(p.type()) and p._max > 1)
+      _values.all_numbers(p.dest()).push_back(numbers[i]);
+    _values.is_set_by_user(p.dest(), true);
+  }
+}
+
+// without creating Option objects, except for unit types
+void OptionParser::set_table_default_values() {
+  for (list<OptionTable>::const_iterator t = _tables.begin(); t != _tables.end(); ++t) {
+    for (size_t i = 0; i < t->size; ++i) {
+      const char* table_def = t->default_value(i);
+      if (not *table_def and _defaults.empty())
+        continue;
+      const string dest = t->dest(i);
+      strMap::const_iterator it = _defaults.find(dest);
+      const string def = (it != _defaults.end()) ? it->second : table_def;
+      if (def != "" and not _values.is_set(dest)) {
+        _values[dest] = def;
+        double number;
+        if (unit_type(t->type(i)) and table_option(*t, i).check_type(*this, "", def, &number) == "")
+          _values.number(dest, number);
+      }
+    }
+  }
+}
+
+void OptionParser::set_default_values(const list<Option>& opts) {
+  for (list<Option>::const_iterator it = opts.begin(); it != opts.end(); ++it) {
+    const string& def = it->get_default(this);
+    if (def != "" and not _values.is_set(it->dest())) {
+      _values[it->dest()] = def;
+      double number;
+      if (unit_type(it->type()) and it->check_type(*this, "", def, &number) == "")
+        _values.number(it->dest(), number);
+    }
+  }
 }
 
-void OptionParser::process_opt(const Option& o, const string& opt, const string& value) {
+void OptionParser::process_opt(const Option& o, const string& opt, const string& value,
+    const string& where /* = "" */) {
+  if (checks_files(o) and (o.action() == "store" or o.action() == "append"))
+    _uncacheable = true;
   if (o.action() == "store") {
-    string err = o.check_type(opt, value);
+    double number;
+    string err = o.check_type(*this, opt, value, &number);
     if (err != "")
-      error(err);
+      error(where + err);
     _values[o.dest()] = value;
+    if (unit_type(o.type()))
+      _values.number(o.dest(), number);
     _values.is_set_by_user(o.dest(), true);
   }
   else if (o.action() == "store_const") {
@@ -353,10 +1031,15 @@ void OptionParser::process_opt(const Option& o, const string& opt, const string&
     _values.is_set_by_user(o.dest(), true);
   }
   else if (o.action() == "append") {
-    string err = o.check_type(opt, value);
+    double number;
+    string err = o.check_type(*this, opt, value, &number);
     if (err != "")
-      error(err);
+      error(where + err);
     _values[o.dest()] = value;
+    if (unit_type(o.type())) {
+      _values.number(o.dest(), number);
+      _values.all_numbers(o.dest()).push_back(number);
+    }
     _values.all(o.dest()).push_back(value);
     _values.is_set_by_user(o.dest(), true);
   }
@@ -370,21 +1053,224 @@ void OptionParser::process_opt(const Option& o, const string& opt, const string&
     _values.is_set_by_user(o.dest(), true);
   }
   else if (o.action() == "help") {
+    _uncacheable = true;
     print_help();
     std::exit(0);
   }
   else if (o.action() == "version") {
+    _uncacheable = true;
     print_version();
     std::exit(0);
   }
   else if (o.action() == "callback" && o.callback()) {
-    string err = o.check_type(opt, value);
+    _uncacheable = true;
+    string err = o.check_type(*this, opt, value);
     if (err != "")
-      error(err);
+      error(where + err);
+#if __cplusplus >= 201103L
+    if (AsyncCallback* ac = dynamic_cast<AsyncCallback*>(o.callback())) {
+      _async_callbacks.push_back(make_pair(opt, async(launch::async, [ac, &o, opt, value, this] {
+        (*ac)(o, opt, value, *this);
+      }).share()));
+      return;
+    }
+#endif
     (*o.callback())(o, opt, value, *this);
   }
 }
 
+#if __cplusplus >= 201103L
+// wait for all callbacks first, then report the first failure in argument order
+void OptionParser::join_async_callbacks(bool report) const {
+  list<pair<string, shared_future<void> > > pending;
+  pending.swap(_async_callbacks);
+  for (list<pair<string, shared_future<void> > >::iterator it = pending.begin(); it != pending.end(); ++it)
+    it->second.wait();
+  for (list<pair<string, shared_future<void> > >::iterator it = pending.begin(); report and it != pending.end(); ++it) {
+    try {
+      it->second.get();
+    } catch (const exception& e) {
+      error(_("option") + string(" ") + it->first + ": " + e.what());
+    }
+  }
+}
+#endif
+
+const UnitType* OptionParser::unit_type(const string& name) const {
+  static const SizeType size_type;
+  static const DurationType duration_type;
+  static const PercentType percent_type;
+  map<string, UnitType const*>::const_iterator it = _unit_types.find(name);
+  if (it != _unit_types.end())
+    return it->second;
+  if (name == "size")
+    return &size_type;
+  if (name == "duration")
+    return &duration_type;
+  if (name == "percent")
+    return &percent_type;
+  return 0;
+}
+
+// how well an option stands for the value of its dest in the environment,
+// 0: not at all (its value is a constant or it has none)
+static int dest_rank(const Option& o) {
+  if (o.action() == "store" or o.action() == "append")
+    return 3;
+  if (o.action() == "count")
+    return 2;
+  if (o.action() == "store_true" or o.action() == "store_false")
+    return 1;
+  return 0;
+}
+// flags are switched on by any value except these
+static bool is_false(const string& value) {
+  return value == "" or value == "0" or value == "false" or value == "no" or value == "off";
+}
+
+// a value from the environment or a config file for o; by_dest: it is the
+// value of the dest, not a value of the option itself (which only differs
+// for store_false options); where prefixes error messages
+void OptionParser::process_value(const Option& o, const string& name, const string& value, bool by_dest,
+    const string& where) {
+  if (o.action() == "store_true" or o.action() == "store_false") {
+    const bool given = not is_false(value);
+    const bool on = (by_dest or o.action() == "store_true") ? given : not given;
+    _values[o.dest()] = on ? "1" : "0";
+    _values.is_set_by_user(o.dest(), true);
+  }
+  else if (o.action() == "count") {
+    if (value.find_first_not_of("0123456789") != string::npos or value == "")
+      error(where + _("option") + " " + name + ": " + _("invalid integer value") + ": '" + value + "'");
+    _values[o.dest()] = value;
+    _values.is_set_by_user(o.dest(), true);
+  }
+  else if (o.nargs() == 0 and is_false(value))
+    return;
+  else
+    process_opt(o, name, value, where);
+}
+
+// one pass over the environment, values given on the command line win
+// variables named by Option::env() act like the option, those named by
+// env_prefix() set the dest through the option that stands for it best;
+// only rebuilt when options were added or the prefix changed
+void OptionParser::bind_env() {
+  if (_env_bound_generation == options_generation() and _env_bound_prefix == env_prefix())
+    return;
+  map<string, pair<Option const*, bool> > bound;
+  map<string, Option const*> dests;
+  list<list<Option> const*> containers(1, &_opts);
+  bool tables_env = env_prefix() != "";
+  for (list<OptionTable>::const_iterator t = _tables.begin(); t != _tables.end(); ++t)
+    tables_env = tables_env or t->env_count > 0;
+  if (tables_env) {
+    materialize_tables();
+    containers.push_back(&_table_opts);
+  }
+  for (list<OptionGroup const*>::const_iterator it = _groups.begin(); it != _groups.end(); ++it)
+    containers.push_back(&(*it)->_opts);
+  for (list<list<Option> const*>::const_iterator c = containers.begin(); c != containers.end(); ++c) {
+    for (list<Option>::const_iterator it = (*c)->begin(); it != (*c)->end(); ++it) {
+      if (it->action() == "help" or it->action() == "version")
+        continue;
+      if (it->env() != "")
+        bound[it->env()] = make_pair(&*it, false);
+      Option const*& rep = dests[it->dest()];
+      if (env_prefix() != "" and it->dest() != "" and dest_rank(*it) > (rep ? dest_rank(*rep) : 0))
+        rep = &*it;
+    }
+  }
+  for (map<string, Option const*>::const_iterator it = dests.begin(); it != dests.end(); ++it) {
+    if (not it->second)
+      continue;
+    string name = env_prefix() + it->first;
+    transform(name.begin() + env_prefix().length(), name.end(), name.begin() + env_prefix().length(), ::toupper);
+    bound.insert(make_pair(name, make_pair(it->second, true)));
+  }
+  _env_bound.swap(bound);
+  _env_bound_generation = options_generation();
+  _env_bound_prefix = env_prefix();
+}
+
+// the command line wins over the environment
+void OptionParser::process_env() {
+  bind_env();
+  if (_env_bound.empty())
+    return;
+  _uncacheable = true;
+
+  for (char** e = environ; e and *e; ++e) {
+    const char* eq = strchr(*e, '=');
+    if (not eq)
+      continue;
+    map<string, pair<Option const*, bool> >::const_iterator it = _env_bound.find(string(*e, eq - *e));
+    if (it != _env_bound.end() and not _values.is_set_by_user(it->second.first->dest()))
+      process_value(*it->second.first, it->first, eq + 1, it->second.second, "");
+  }
+}
+
+// files added later are processed first, entries of one file for the
+// same dest (e.g. several lines for an append option) are all applied;
+// values are taken like those of the environment, see process_value()
+void OptionParser::process_config_files() {
+  if (_config_files.empty())
+    return;
+  _uncacheable = true;
+
+  map<string, Option const*> dests;
+  list<list<Option> const*> containers(1, &_opts);
+  if (not _tables.empty()) {
+    materialize_tables();
+    containers.push_back(&_table_opts);
+  }
+  for (list<OptionGroup const*>::const_iterator it = _groups.begin(); it != _groups.end(); ++it)
+    containers.push_back(&(*it)->_opts);
+  for (list<list<Option> const*>::const_iterator c = containers.begin(); c != containers.end(); ++c) {
+    for (list<Option>::const_iterator it = (*c)->begin(); it != (*c)->end(); ++it) {
+      Option const*& rep = dests[it->dest()];
+      if (it->dest() != "" and dest_rank(*it) > (rep ? dest_rank(*rep) : 0))
+        rep = &*it;
+    }
+  }
+
+  // dests given in a file (even if switched off) are not read from the following ones
+  set<string> decided;
+  for (list<pair<ConfigFile const*, string> >::const_reverse_iterator f = _config_files.rbegin(); f != _config_files.rend(); ++f) {
+    const ConfigFile& file = *f->first;
+    set<string> from_file;
+    const list<ConfigFile::Entry>& entries = file.section(f->second);
+    for (list<ConfigFile::Entry>::const_iterator e = entries.begin(); e != entries.end(); ++e) {
+      stringstream where;
+      where << file.filename() << ":" << e->line << ": ";
+      if (e->key == "")
+        error(where.str() + _("syntax error"));
+
+      Option const* option = 0;
+      optMap::const_iterator it = _optmap_l.find(e->key);
+      if (it != _optmap_l.end())
+        option = it->second;
+      if (not option)
+        option = find_table_long(e->key);
+      for (list<OptionGroup const*>::const_iterator g = _groups.begin(); not option and g != _groups.end(); ++g)
+        if ((it = (*g)->_optmap_l.find(e->key)) != (*g)->_optmap_l.end())
+          option = it->second;
+      const bool by_dest = not option;
+      if (by_dest and dests.count(e->key))
+        option = dests[e->key];
+      if (not option or option->action() == "help" or option->action() == "version")
+        error(where.str() + _("no such option") + ": " + e->key);
+
+      const string& dest = option->dest();
+      if ((_values.is_set_by_user(dest) or decided.count(dest)) and not from_file.count(dest))
+        continue;
+      from_file.insert(dest);
+      process_value(*option, by_dest ? e->key : "--" + e->key, e->value, by_dest, where.str());
+    }
+    decided.insert(from_file.begin(), from_file.end());
+  }
+}
+
 string OptionParser::format_help() const {
   stringstream ss;
 
@@ -395,7 +1281,11 @@ string OptionParser::format_help() const {
     ss << str_format(description(), 0, cols()) << endl;
 
   ss << _("Options") << ":" << endl;
-  ss << format_option_help();
+  vector<Option const*> opts;
+  container_options(0, opts);
+  for (vector<Option const*>::const_iterator it = opts.begin(); it != opts.end(); ++it)
+    if ((*it)->help() != SUPPRESS_HELP)
+      ss << (*it)->format_help(this);
 
   for (list<OptionGroup const*>::const_iterator it = _groups.begin(); it != _groups.end(); ++it) {
     const OptionGroup& group = **it;
@@ -404,7 +1294,10 @@ string OptionParser::format_help() const {
       unsigned int malus = 4; // Python seems to not use full length
       ss << str_format(group.description(), 4, cols() - malus) << endl;
     }
-    ss << group.format_option_help(4);
+    container_options(&group, opts);
+    for (vector<Option const*>::const_iterator o = opts.begin(); o != opts.end(); ++o)
+      if ((*o)->help() != SUPPRESS_HELP)
+        ss << (*o)->format_help(this, 4);
   }
 
   if (epilog() != "")
@@ -453,57 +1346,692 @@ void OptionParser::print_version() const {
   print_version(cout);
 }
 
+string OptionParser::dump_schema() const {
+  // the parser itself (without title), followed by its groups
+  vector<OptionGroup const*> containers(1, static_cast<OptionGroup const*>(0));
+  containers.insert(containers.end(), _groups.begin(), _groups.end());
+  vector<vector<Option const*> > opts(containers.size());
+  vector<map<string, size_t> > longs(containers.size());
+  size_t records = 0, long_entries = 0;
+  for (size_t c = 0; c < containers.size(); ++c) {
+    container_options(containers[c], opts[c]);
+    // later options take the name, as in add_option()
+    for (size_t i = 0; i < opts[c].size(); ++i)
+      for (set<string>::const_iterator n = opts[c][i]->_long_opts.begin(); n != opts[c][i]->_long_opts.end(); ++n)
+        longs[c][*n] = i;
+    records += opts[c].size();
+    long_entries += longs[c].size();
+  }
+
+  // fixed-size parts first, zero filled, strings and lists are appended
+  const size_t settings = schema_header;
+  const size_t defaults = settings + 4*cfg_fields;
+  const size_t positional_table = defaults + 8*_defaults.size();
+  const size_t container_table = positional_table + schema_positional * _positionals.size();
+  const size_t record_table = container_table + schema_container * containers.size();
+  const size_t index_table = record_table + schema_record * records;
+  string buf("OPTS", 4);
+  put_u32(buf, SCHEMA_VERSION);
+  buf.resize(index_table + 8*long_entries + 4*schema_shorts * containers.size());
+
+  set_u32(buf, settings + 4*cfg_usage, put_str(buf, _usage));
+  set_u32(buf, settings + 4*cfg_version, put_str(buf, _version));
+  set_u32(buf, settings + 4*cfg_prog, put_str(buf, _prog));
+  set_u32(buf, settings + 4*cfg_epilog, put_str(buf, _epilog));
+  set_u32(buf, settings + 4*cfg_env_prefix, put_str(buf, _env_prefix));
+  set_u32(buf, settings + 4*cfg_flags,
+      (_add_help_option ? 1 : 0) | (_add_version_option ? 2 : 0) | (_interspersed_args ? 4 : 0));
+  set_u32(buf, settings + 4*cfg_default_count, _defaults.size());
+  set_u32(buf, settings + 4*cfg_defaults, defaults);
+  set_u32(buf, settings + 4*cfg_container_count, containers.size());
+  set_u32(buf, settings + 4*cfg_containers, container_table);
+  size_t pos = defaults;
+  for (strMap::const_iterator it = _defaults.begin(); it != _defaults.end(); ++it, pos += 8) {
+    set_u32(buf, pos, put_str(buf, it->first));
+    set_u32(buf, pos + 4, put_str(buf, it->second));
+  }
+  set_u32(buf, settings + 4*cfg_positional_count, _positionals.size());
+  set_u32(buf, settings + 4*cfg_positionals, positional_table);
+  pos = positional_table;
+  for (list<Positional>::const_iterator it = _positionals.begin(); it != _positionals.end(); ++it) {
+    const list<string>& choices = it->_option.choices();
+    set_u32(buf, pos + 4*arg_name, put_str(buf, it->name()));
+    set_u32(buf, pos + 4*arg_dest, put_str(buf, it->dest()));
+    set_u32(buf, pos + 4*arg_type, put_str(buf, it->type()));
+    set_u32(buf, pos + 4*arg_min, it->_min);
+    set_u32(buf, pos + 4*arg_max, (it->_max == Positional::UNLIMITED) ? 0xffffffffu : it->_max);
+    set_u32(buf, pos + 4*arg_choice_count, choices.size());
+    set_u32(buf, pos + 4*arg_choices, put_str_list(buf, choices.begin(), choices.end()));
+    pos += schema_positional;
+  }
+
+  size_t rec = record_table, index = index_table;
+  for (size_t c = 0; c < containers.size(); ++c) {
+    const OptionGroup* group = containers[c];
+    const size_t con = container_table + c * schema_container;
+    const size_t long_index = index, short_index = index + 8*longs[c].size();
+    index = short_index + 4*schema_shorts;
+    set_u32(buf, con + 4*con_title, put_str(buf, group ? group->title() : ""));
+    set_u32(buf, con + 4*con_description, put_str(buf, group ? group->description() : description()));
+    set_u32(buf, con + 4*con_option_count, opts[c].size());
+    set_u32(buf, con + 4*con_options, rec);
+    set_u32(buf, con + 4*con_long_count, longs[c].size());
+    set_u32(buf, con + 4*con_long_index, long_index);
+    set_u32(buf, con + 4*con_short_index, short_index);
+
+    map<string, unsigned int> names;
+    size_t env_count = 0;
+    for (size_t i = 0; i < opts[c].size(); ++i, rec += schema_record) {
+      const Option& o = *opts[c][i];
+      for (set<string>::const_iterator n = o._short_opts.begin(); n != o._short_opts.end(); ++n)
+        if (*n != "")
+          set_u32(buf, short_index + 4*static_cast<unsigned char>((*n)[0]), i + 1);
+      set_u32(buf, rec + 4*rec_short_count, o._short_opts.size());
+      set_u32(buf, rec + 4*rec_shorts, put_str_list(buf, o._short_opts.begin(), o._short_opts.end()));
+      const unsigned int long_list = put_str_list(buf, o._long_opts.begin(), o._long_opts.end());
+      size_t j = 0;
+      for (set<string>::const_iterator n = o._long_opts.begin(); n != o._long_opts.end(); ++n, ++j)
+        names[*n] = get_u32(buf.data() + long_list + 4*j);
+      set_u32(buf, rec + 4*rec_long_count, o._long_opts.size());
+      set_u32(buf, rec + 4*rec_longs, long_list);
+      set_u32(buf, rec + 4*rec_action, put_str(buf, o._action));
+      set_u32(buf, rec + 4*rec_type, put_str(buf, o._type));
+      set_u32(buf, rec + 4*rec_dest, put_str(buf, o._dest));
+      set_u32(buf, rec + 4*rec_default, put_str(buf, o._default));
+      set_u32(buf, rec + 4*rec_nargs, o._nargs);
+      set_u32(buf, rec + 4*rec_const, put_str(buf, o._const));
+      set_u32(buf, rec + 4*rec_choice_count, o._choices.size());
+      set_u32(buf, rec + 4*rec_choices, put_str_list(buf, o._choices.begin(), o._choices.end()));
+      set_u32(buf, rec + 4*rec_help, put_str(buf, o._help));
+      set_u32(buf, rec + 4*rec_metavar, put_str(buf, o._metavar));
+      set_u32(buf, rec + 4*rec_env, put_str(buf, o._env));
+      env_count += (o._env != "") ? 1 : 0;
+    }
+    set_u32(buf, con + 4*con_env_count, env_count);
+    size_t k = long_index;
+    for (map<string, size_t>::const_iterator it = longs[c].begin(); it != longs[c].end(); ++it, k += 8) {
+      set_u32(buf, k, names[it->first]);
+      set_u32(buf, k + 4, it->second);
+    }
+  }
+
+  set_u32(buf, 8, buf.size());
+  set_u32(buf, 12, checksum(buf.data() + schema_header, buf.size() - schema_header));
+  return buf;
+}
+
+// only the tables are checked here, strings are checked when they are read
+bool OptionParser::load_schema(const void* data, size_t size) {
+  const char* p = static_cast<const char*>(data);
+  if (size < schema_header or memcmp(p, "OPTS", 4) != 0 or get_u32(p + 4) != SCHEMA_VERSION or
+      get_u32(p + 8) != size or get_u32(p + 12) != checksum(p + schema_header, size - schema_header))
+    return false;
+
+  const blob_view in(p, size);
+  const size_t settings = schema_header;
+  const size_t ndefaults = in.u32(settings + 4*cfg_default_count), defaults = in.u32(settings + 4*cfg_defaults);
+  const size_t ncontainers = in.u32(settings + 4*cfg_container_count);
+  const size_t containers = in.u32(settings + 4*cfg_containers);
+  const size_t npositionals = in.u32(settings + 4*cfg_positional_count);
+  const size_t positionals = in.u32(settings + 4*cfg_positionals);
+  if (not in.fits(settings, cfg_fields, 4) or not in.fits(defaults, ndefaults, 8) or ncontainers == 0 or
+      not in.fits(containers, ncontainers, schema_container) or
+      not in.fits(positionals, npositionals, schema_positional))
+    return false;
+  for (size_t i = 0; i < npositionals; ++i) {
+    const size_t arg = positionals + i * schema_positional;
+    if (in.u32(arg + 4*arg_min) > in.u32(arg + 4*arg_max) or
+        not in.fits(in.u32(arg + 4*arg_choices), in.u32(arg + 4*arg_choice_count), 4))
+      return false;
+  }
+  for (size_t c = 0; c < ncontainers; ++c) {
+    const size_t con = containers + c * schema_container;
+    const size_t n = in.u32(con + 4*con_option_count), nlong = in.u32(con + 4*con_long_count);
+    const size_t long_index = in.u32(con + 4*con_long_index), short_index = in.u32(con + 4*con_short_index);
+    if (not in.fits(in.u32(con + 4*con_options), n, schema_record) or not in.fits(long_index, nlong, 8) or
+        not in.fits(short_index, schema_shorts, 4))
+      return false;
+    for (size_t k = 0; k < nlong; ++k)
+      if (in.u32(long_index + 8*k + 4) >= n)
+        return false;
+    // the lists of names and choices of every record, see table_option()
+    for (size_t r = 0; r < n; ++r) {
+      const size_t rec = in.u32(con + 4*con_options) + r * schema_record;
+      if (not in.fits(in.u32(rec + 4*rec_shorts), in.u32(rec + 4*rec_short_count), 4) or
+          not in.fits(in.u32(rec + 4*rec_longs), in.u32(rec + 4*rec_long_count), 4) or
+          not in.fits(in.u32(rec + 4*rec_choices), in.u32(rec + 4*rec_choice_count), 4))
+        return false;
+    }
+    for (size_t ch = 0; ch < schema_shorts; ++ch)
+      if (in.u32(short_index + 4*ch) > n)
+        return false;
+  }
+
+  _usage = in.str(in.u32(settings + 4*cfg_usage));
+  _version = in.str(in.u32(settings + 4*cfg_version));
+  _prog = in.str(in.u32(settings + 4*cfg_prog));
+  _epilog = in.str(in.u32(settings + 4*cfg_epilog));
+  _env_prefix = in.str(in.u32(settings + 4*cfg_env_prefix));
+  const unsigned int flags = in.u32(settings + 4*cfg_flags);
+  _add_help_option = flags & 1;
+  _add_version_option = flags & 2;
+  _interspersed_args = flags & 4;
+  for (size_t i = 0; i < ndefaults; ++i)
+    _defaults[in.str(in.u32(defaults + 8*i))] = in.str(in.u32(defaults + 8*i + 4));
+  for (size_t i = 0; i < npositionals; ++i) {
+    const size_t arg = positionals + i * schema_positional;
+    Positional& positional = add_positional(in.str(in.u32(arg + 4*arg_name)));
+    if (size_t n = in.u32(arg + 4*arg_choice_count)) {
+      vector<string> choices;
+      for (size_t j = 0; j < n; ++j)
+        choices.push_back(in.str(in.u32(in.u32(arg + 4*arg_choices) + 4*j)));
+      positional.choices(choices.begin(), choices.end());
+    }
+    const size_t max = in.u32(arg + 4*arg_max);
+    positional.dest(in.str(in.u32(arg + 4*arg_dest))).type(in.str(in.u32(arg + 4*arg_type)))
+      .nargs(in.u32(arg + 4*arg_min), (max == 0xffffffffu) ? Positional::UNLIMITED : max);
+  }
+
+  for (size_t c = 0; c < ncontainers; ++c) {
+    const size_t con = containers + c * schema_container;
+    const OptionGroup* group = 0;
+    if (c == 0)
+      _description = in.str(in.u32(con + 4*con_description));
+    else {
+      _schema_groups.push_back(OptionGroup(*this, in.str(in.u32(con + 4*con_title)),
+            in.str(in.u32(con + 4*con_description))));
+      group = &_schema_groups.back();
+      add_option_group(*group);
+    }
+    _tables.push_back(OptionTable());
+    OptionTable& t = _tables.back();
+    t.blob = p;
+    t.blob_size = size;
+    t.records = in.u32(con + 4*con_options);
+    t.size = in.u32(con + 4*con_option_count);
+    t.long_index = in.u32(con + 4*con_long_index);
+    t.long_count = in.u32(con + 4*con_long_count);
+    t.short_index = in.u32(con + 4*con_short_index);
+    t.env_count = in.u32(con + 4*con_env_count);
+    t.group = group;
+  }
+  _generation++;
+  return true;
+}
+
 void OptionParser::exit() const {
   throw 2;
 }
 void OptionParser::error(const string& msg) const {
+#if __cplusplus >= 201103L
+  // running callbacks were started by earlier arguments, their failures come first
+  join_async_callbacks(true);
+#endif
   print_usage(cerr);
   cerr << prog() << ": " << _("error") << ": " << msg << endl;
   exit();
 }
 ////////// } class OptionParser //////////
 
+////////// class Arena { //////////
+// enough for any fundamental type
+static const size_t arena_align = 2 * sizeof(void*) > sizeof(long double) ? 2 * sizeof(void*) : sizeof(long double);
+static size_t arena_round(size_t n) {
+  return (n + arena_align - 1) / arena_align * arena_align;
+}
+
+Arena::Arena(size_t block_size) :
+  _buffer(0), _buffer_size(0), _block_size(block_size), _blocks(0), _cur(0), _end(0), _allocated(0),
+  _values(0) {}
+Arena::Arena(void* buffer, size_t size, size_t block_size) :
+  _buffer(static_cast<char*>(buffer)), _buffer_size(size), _block_size(block_size), _blocks(0),
+  _cur(0), _end(0), _allocated(0), _values(0) {
+  release();
+}
+
+// heap blocks start with a pointer to the previous block
+void* Arena::allocate(size_t n) {
+  n = arena_round(n ? n : 1);
+  if (n > static_cast<size_t>(_end - _cur)) {
+    size_t header = arena_round(sizeof(void*));
+    size_t size = max(_block_size, header + n);
+    char* block = static_cast<char*>(::operator new(size));
+    *reinterpret_cast<void**>(block) = _blocks;
+    _blocks = block;
+    _cur = block + header;
+    _end = block + size;
+  }
+  void* p = _cur;
+  _cur += n;
+  _allocated += n;
+  return p;
+}
+
+// the values are emptied while their nodes are still valid
+void Arena::release() {
+  while (_values)
+    Values().swap(*_values);
+  while (_blocks) {
+    void* prev = *static_cast<void**>(_blocks);
+    ::operator delete(_blocks);
+    _blocks = prev;
+  }
+  _cur = _end = 0;
+  if (_buffer) {
+    size_t skip = (arena_align - reinterpret_cast<size_t>(_buffer) % arena_align) % arena_align;
+    if (skip < _buffer_size) {
+      _cur = _buffer + skip;
+      _end = _buffer + _buffer_size;
+    }
+  }
+  _allocated = 0;
+}
+////////// } class Arena //////////
+
 ////////// class Values { //////////
 const string& Values::operator[] (const string& d) const {
-  strMap::const_iterator it = _map.find(d);
+  valMap::const_iterator it = _map.find(d);
   static const string empty = "";
   return (it != _map.end()) ? it->second : empty;
 }
+list<string>& Values::all(const string& d) {
+  return _appendMap[d];
+}
+const list<string>& Values::all(const string& d) const {
+  appMap::const_iterator it = _appendMap.find(d);
+  static const list<string> empty;
+  return (it != _appendMap.end()) ? it->second : empty;
+}
+double Values::number(const string& d) const {
+  numMap::const_iterator it = _numbers.find(d);
+  return (it != _numbers.end()) ? it->second : 0;
+}
+const vector<double>& Values::all_numbers(const string& d) const {
+  numLstMap::const_iterator it = _numberLists.find(d);
+  static const vector<double> empty;
+  return (it != _numberLists.end()) ? it->second : empty;
+}
+Values::Values(Arena& a) :
+  _map(valMap::key_compare(), &a), _appendMap(appMap::key_compare(), &a),
+  _userSet(strSet::key_compare(), &a), _numbers(numMap::key_compare(), &a),
+  _numberLists(numLstMap::key_compare(), &a), _parsed(false),
+  _arena(0), _arena_prev(0), _arena_next(0) {
+  link(&a);
+}
+Values::Values(const Values& other) :
+  _map(other._map.begin(), other._map.end()),
+  _appendMap(other._appendMap.begin(), other._appendMap.end()),
+  _userSet(other._userSet.begin(), other._userSet.end()),
+  _numbers(other._numbers.begin(), other._numbers.end()),
+  _numberLists(other._numberLists.begin(), other._numberLists.end()),
+  _parsed(other._parsed),
+  _arena(0), _arena_prev(0), _arena_next(0) {}
+
+// the allocators (and with them the membership in the arena) are swapped as well
+void Values::swap(Values& other) {
+  _map.swap(other._map);
+  _appendMap.swap(other._appendMap);
+  _userSet.swap(other._userSet);
+  _numbers.swap(other._numbers);
+  _numberLists.swap(other._numberLists);
+  std::swap(_parsed, other._parsed);
+  Arena* a = _arena;
+  Arena* b = other._arena;
+  unlink();
+  other.unlink();
+  link(b);
+  other.link(a);
+}
+
+void Values::link(Arena* a) {
+  _arena = a;
+  if (not a)
+    return;
+  _arena_prev = 0;
+  _arena_next = a->_values;
+  if (_arena_next)
+    _arena_next->_arena_prev = this;
+  a->_values = this;
+}
+void Values::unlink() {
+  if (not _arena)
+    return;
+  if (_arena_prev)
+    _arena_prev->_arena_next = _arena_next;
+  else
+    _arena->_values = _arena_next;
+  if (_arena_next)
+    _arena_next->_arena_prev = _arena_prev;
+  _arena = 0;
+  _arena_prev = _arena_next = 0;
+}
 void Values::is_set_by_user(const string& d, bool yes) {
   if (yes)
     _userSet.insert(d);
   else
     _userSet.erase(d);
 }
+
+// Layout (all integers u32, see put_u32):
+//   header:  "OPTV" version count size
+//   entries: count * (key val flags list_count list_off number number_count number_off),
+//            sorted by key
+//   strings: length, bytes, '\0'
+// val is 0 if the dest is not set, list_off points to list_count string
+// offsets. flags: 1 set by user, 2 has a number. Numbers are doubles (see
+// put_f64), number_off points to number_count of them.
+static const char packed_magic[4] = { 'O', 'P', 'T', 'V' };
+static const size_t packed_header = 16;
+static const size_t packed_entry = 36;
+
+string Values::pack() const {
+  set<string> keys;
+  for (valMap::const_iterator it = _map.begin(); it != _map.end(); ++it)
+    keys.insert(it->first);
+  for (appMap::const_iterator it = _appendMap.begin(); it != _appendMap.end(); ++it)
+    keys.insert(it->first);
+  for (numMap::const_iterator it = _numbers.begin(); it != _numbers.end(); ++it)
+    keys.insert(it->first);
+  for (numLstMap::const_iterator it = _numberLists.begin(); it != _numberLists.end(); ++it)
+    keys.insert(it->first);
+  keys.insert(_userSet.begin(), _userSet.end());
+
+  string buf(packed_magic, 4);
+  put_u32(buf, PackedValues::VERSION);
+  put_u32(buf, keys.size());
+  put_u32(buf, 0);
+  buf.resize(packed_header + keys.size() * packed_entry);
+
+  size_t entry = packed_header;
+  for (set<string>::const_iterator it = keys.begin(); it != keys.end(); ++it, entry += packed_entry) {
+    set_u32(buf, entry, put_str(buf, *it));
+    valMap::const_iterator val = _map.find(*it);
+    set_u32(buf, entry + 4, (val != _map.end()) ? put_str(buf, val->second) : 0);
+    numMap::const_iterator num = _numbers.find(*it);
+    set_u32(buf, entry + 8, (is_set_by_user(*it) ? 1 : 0) | (num != _numbers.end() ? 2 : 0));
+    if (num != _numbers.end()) {
+      string bits;
+      put_f64(bits, num->second);
+      buf.replace(entry + 20, 8, bits);
+    }
+    appMap::const_iterator lst = _appendMap.find(*it);
+    if (lst != _appendMap.end()) {
+      set_u32(buf, entry + 12, lst->second.size());
+      set_u32(buf, entry + 16, put_str_list(buf, lst->second.begin(), lst->second.end()));
+    }
+    numLstMap::const_iterator nums = _numberLists.find(*it);
+    if (nums != _numberLists.end()) {
+      set_u32(buf, entry + 28, nums->second.size());
+      set_u32(buf, entry + 32, buf.size());
+      for (vector<double>::const_iterator i = nums->second.begin(); i != nums->second.end(); ++i)
+        put_f64(buf, *i);
+    }
+  }
+  set_u32(buf, 12, buf.size());
+  return buf;
+}
 ////////// } class Values //////////
 
+////////// class ConfigFile { //////////
+ConfigFile::ConfigFile(const string& filename) :
+  _filename(), _data(0), _size(0), _mapped(false), _buffer(), _sections(), _order() {
+  open(filename);
+}
+
+bool ConfigFile::open(const string& filename) {
+  close();
+  _filename = filename;
+#ifndef _WIN32
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  if (fstat(fd, &st) == 0 and st.st_size > 0) {
+    void* p = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p != MAP_FAILED) {
+      _data = static_cast<const char*>(p);
+      _size = st.st_size;
+      _mapped = true;
+    }
+  }
+  ::close(fd);
+#endif
+  if (not _data) {
+    // empty files, pipes and systems without mmap()
+    ifstream in(filename.c_str(), ios::in | ios::binary);
+    if (not in)
+      return false;
+    stringstream ss;
+    ss << in.rdbuf();
+    _buffer = ss.str();
+    _data = _buffer.c_str();
+    _size = _buffer.size();
+  }
+  index();
+  return true;
+}
+
+void ConfigFile::close() {
+#ifndef _WIN32
+  if (_mapped)
+    munmap(const_cast<char*>(_data), _size);
+#endif
+  _data = 0;
+  _size = 0;
+  _mapped = false;
+  _buffer.clear();
+  _sections.clear();
+  _order.clear();
+}
+
+// only looks at the first character of each line
+void ConfigFile::index() {
+  _sections[""].bodies.push_back(make_pair(size_t(0), 1u));
+  _order.push_back("");
+  unsigned int line = 1;
+  for (const char* p = _data; p < _data + _size; ++line) {
+    const char* eol = static_cast<const char*>(memchr(p, '\n', _data + _size - p));
+    if (not eol)
+      eol = _data + _size;
+    while (p != eol and is_blank(*p))
+      ++p;
+    if (p != eol and *p == '[') {
+      const char* end = static_cast<const char*>(memchr(p, ']', eol - p));
+      if (end) {
+        string name = str_trim(p + 1, end);
+        Section& s = _sections[name];
+        if (s.bodies.empty())
+          _order.push_back(name);
+        s.bodies.push_back(make_pair(size_t(eol - _data), line));
+      }
+    }
+    p = eol + 1;
+  }
+}
+
+const list<ConfigFile::Entry>& ConfigFile::section(const string& name) const {
+  static const list<Entry> empty;
+  map<string, Section>::iterator it = _sections.find(name);
+  if (it == _sections.end())
+    return empty;
+  Section& s = it->second;
+  if (s.parsed)
+    return s.entries;
+
+  for (size_t i = 0; i < s.bodies.size(); ++i) {
+    // the offset points to the end of the header line (0 for section "")
+    const char* p = _data + s.bodies[i].first;
+    unsigned int line = s.bodies[i].second;
+    if (p != _data) {
+      ++p;
+      ++line;
+    }
+    for (; p < _data + _size; ++line) {
+      const char* eol = static_cast<const char*>(memchr(p, '\n', _data + _size - p));
+      if (not eol)
+        eol = _data + _size;
+      while (p != eol and is_blank(*p))
+        ++p;
+      if (p != eol and *p == '[' and memchr(p, ']', eol - p))
+        break;
+      if (p != eol and *p != '#' and *p != ';') {
+        const char* delim = p;
+        while (delim != eol and *delim != '=' and *delim != ':')
+          ++delim;
+        if (delim == eol or delim == p)
+          s.entries.push_back(Entry("", string(p, eol), line));
+        else
+          s.entries.push_back(Entry(str_trim(p, delim), str_trim(delim + 1, eol), line));
+      }
+      p = eol + 1;
+    }
+  }
+  s.parsed = true;
+  return s.entries;
+}
+////////// } class ConfigFile //////////
+
+////////// class PackedValues { //////////
+PackedValues::PackedValues(const void* data, size_t size) : _data(0), _size(0), _count(0) {
+  const char* p = static_cast<const char*>(data);
+  if (size < packed_header or memcmp(p, packed_magic, 4) != 0)
+    return;
+  size_t count = get_u32(p + 4*2);
+  if (get_u32(p + 4) != VERSION or get_u32(p + 4*3) != size or
+      count > (size - packed_header) / packed_entry)
+    return;
+  _data = p;
+  _size = size;
+  _count = count;
+}
+
+const char* PackedValues::str(size_t off) const {
+  if (off == 0 or off > _size - 5)
+    return 0;
+  size_t len = get_u32(_data + off);
+  if (len > _size - off - 5 or _data[off + 4 + len] != '\0')
+    return 0;
+  return _data + off;
+}
+
+const char* PackedValues::find(const string& d) const {
+  size_t lo = 0, hi = _count;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    const char* entry = _data + packed_header + mid * packed_entry;
+    const char* key = str(get_u32(entry));
+    if (not key)
+      return 0;
+    size_t len = get_u32(key);
+    int cmp = memcmp(key + 4, d.data(), min(len, d.size()));
+    if (cmp == 0)
+      cmp = (len < d.size()) ? -1 : (len > d.size()) ? 1 : 0;
+    if (cmp == 0)
+      return entry;
+    if (cmp < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return 0;
+}
+
+const char* PackedValues::operator[] (const string& d) const {
+  const char* entry = find(d);
+  const char* val = entry ? str(get_u32(entry + 4)) : 0;
+  return val ? val + 4 : "";
+}
+bool PackedValues::is_set(const string& d) const {
+  const char* entry = find(d);
+  return entry and get_u32(entry + 4) != 0;
+}
+bool PackedValues::is_set_by_user(const string& d) const {
+  const char* entry = find(d);
+  return entry and (get_u32(entry + 8) & 1);
+}
+
+size_t PackedValues::count(const string& d) const {
+  const char* entry = find(d);
+  if (not entry)
+    return 0;
+  size_t n = get_u32(entry + 12), off = get_u32(entry + 16);
+  return (off <= _size and n <= (_size - off) / 4) ? n : 0;
+}
+const char* PackedValues::all(const string& d, size_t i) const {
+  if (i >= count(d))
+    return "";
+  const char* val = str(get_u32(_data + get_u32(find(d) + 16) + 4*i));
+  return val ? val + 4 : "";
+}
+double PackedValues::number(const string& d) const {
+  const char* entry = find(d);
+  return (entry and (get_u32(entry + 8) & 2)) ? get_f64(entry + 20) : 0;
+}
+double PackedValues::all_numbers(const string& d, size_t i) const {
+  const char* entry = find(d);
+  if (not entry)
+    return 0;
+  size_t n = get_u32(entry + 28), off = get_u32(entry + 32);
+  if (i >= n or off > _size or i >= (_size - off) / 8)
+    return 0;
+  return get_f64(_data + off + 8*i);
+}
+////////// } class PackedValues //////////
+
 ////////// class Option { //////////
-string Option::check_type(const string& opt, const string& val) const {
+string Option::check_type(const OptionParser& parser, const string& opt, const string& val,
+    double* number /* = 0 */) const {
+  string err = check_value(parser, val, number);
+  return (err != "") ? _("option") + string(" ") + opt + ": " + err : err;
+}
+
+string Option::check_value(const OptionParser& parser, const string& val, double* number) const {
   istringstream ss(val);
   stringstream err;
 
   if (type() == "int" || type() == "long") {
     long t;
     if (not (ss >> t))
-      err << _("option") << " " << opt << ": " << _("invalid integer value") << ": '" << val << "'";
+      err << _("invalid integer value") << ": '" << val << "'";
   }
   else if (type() == "float" || type() == "double") {
     double t;
     if (not (ss >> t))
-      err << _("option") << " " << opt << ": " << _("invalid floating-point value") << ": '" << val << "'";
+      err << _("invalid floating-point value") << ": '" << val << "'";
   }
   else if (type() == "choice") {
     if (find(choices().begin(), choices().end(), val) == choices().end()) {
       list<string> tmp = choices();
       transform(tmp.begin(), tmp.end(), tmp.begin(), str_wrap("'"));
-      err << _("option") << " " << opt << ": " << _("invalid choice") << ": '" << val << "'"
-        << " (" << _("choose from") << " " << str_join(", ", tmp.begin(), tmp.end()) << ")";
+      err << _("invalid choice") << ": '" << val << "'";
+      if (parser.suggest_on_error()) {
+        string match = _choice_index.closest(val, suggest_distance(val));
+        if (match != "")
+          err << ", " << _("maybe you meant") << " '" << match << "'?";
+      }
+      err << " (" << _("choose from") << " " << str_join(", ", tmp.begin(), tmp.end()) << ")";
     }
   }
   else if (type() == "complex") {
     complex<double> t;
     if (not (ss >> t))
-      err << _("option") << " " << opt << ": " << _("invalid complex value") << ": '" << val << "'";
+      err << _("invalid complex value") << ": '" << val << "'";
+  }
+  else if (const UnitType* unit = parser.unit_type(type())) {
+    double t;
+    if (not (*unit)(val, t))
+      err << _("invalid") << " " << type() << " " << _("value") << ": '" << val << "'";
+    else if (number)
+      *number = t;
+  }
+  else if (type() == "existing_file" || type() == "directory") {
+    struct stat st;
+    if (stat(val.c_str(), &st) != 0)
+      err << _("no such file or directory") << ": '" << val << "'";
+    else if (type() == "directory" and (st.st_mode & S_IFMT) != S_IFDIR)
+      err << _("not a directory") << ": '" << val << "'";
+    else if (type() == "existing_file" and (st.st_mode & S_IFMT) == S_IFDIR)
+      err << _("is a directory") << ": '" << val << "'";
   }
 
   return err.str();
@@ -536,7 +2064,7 @@ string Option::format_option_help(unsigned int indent /* = 2 */) const {
   return ss.str();
 }
 
-string Option::format_help(unsigned int indent /* = 2 */) const {
+string Option::format_help(const OptionParser* parser, unsigned int indent /* = 2 */) const {
   stringstream ss;
   string h = format_option_help(indent);
   unsigned int width = cols();
@@ -553,7 +2081,8 @@ string Option::format_help(unsigned int indent /* = 2 */) const {
       ss << endl;
   }
   if (help() != "") {
-    string help_str = (get_default() != "") ? str_replace(help(), "%default", get_default()) : help();
+    const string& def = get_default(parser);
+    string help_str = (def != "") ? str_replace(help(), "%default", def) : help();
     ss << str_format(help_str, opt_width, width, false, indent_first);
   }
   return ss.str();
@@ -578,13 +2107,252 @@ Option& Option::type(const std::string& t) {
   return *this;
 }
 
-const std::string& Option::get_default() const {
-  strMap::const_iterator it = _parser._defaults.find(dest());
-  if (it != _parser._defaults.end())
-    return it->second;
-  else
-    return _default;
+const std::string& Option::get_default(const OptionParser* parser) const {
+  if (not parser)
+    parser = _parser;
+  if (parser) {
+    strMap::const_iterator it = parser->_defaults.find(dest());
+    if (it != parser->_defaults.end())
+      return it->second;
+  }
+  return _default;
+}
+
+// built once, so that options of shared groups are never modified while parsing
+void Option::index_choices() {
+  _choice_index = BKTree();
+  for (list<string>::const_iterator it = _choices.begin(); it != _choices.end(); ++it)
+    _choice_index.insert(*it);
 }
 ////////// } class Option //////////
 
+
+#if __cplusplus >= 201103L
+////////// class ReloadableValues { //////////
+ReloadableValues::~ReloadableValues() {
+  delete _current.load();
+  collect();
+}
+
+const Values& ReloadableValues::reload(int argc, char const* const* argv) {
+  lock_guard<mutex> lock(_mutex);
+  return publish(_parser.parse_args(argc, argv));
+}
+const Values& ReloadableValues::reload(const vector<string>& args) {
+  lock_guard<mutex> lock(_mutex);
+  return publish(_parser.parse_args(args));
+}
+
+// listeners are called on the reloading thread, they must not call reload()
+const Values& ReloadableValues::publish(const Values& values) {
+  const Values* cur = new Values(values);
+  const Values* old = _current.exchange(cur, memory_order_acq_rel);
+  _retired.push_back(old);
+
+  for (multimap<string, ChangeListener*>::const_iterator it = _listeners.begin(); it != _listeners.end(); ++it) {
+    const string& d = it->first;
+    if (old->is_set(d) != cur->is_set(d) or (*old)[d] != (*cur)[d] or old->all(d) != cur->all(d))
+      (*it->second)(d, *old, *cur);
+  }
+  return *cur;
+}
+
+ReloadableValues& ReloadableValues::on_change(const string& dest, ChangeListener& l) {
+  lock_guard<mutex> lock(_mutex);
+  _listeners.insert(make_pair(dest, &l));
+  return *this;
+}
+
+void ReloadableValues::collect() {
+  lock_guard<mutex> lock(_mutex);
+  for (vector<const Values*>::iterator it = _retired.begin(); it != _retired.end(); ++it)
+    delete *it;
+  _retired.clear();
+}
+////////// } class ReloadableValues //////////
+
+////////// class LayeredValues { //////////
+LayeredValues& LayeredValues::push(shared_ptr<const Values> layer) {
+  if (_top)
+    _layers.push_back(move(_top));
+  _layers.push_back(move(layer));
+  return *this;
+}
+
+void LayeredValues::pop() {
+  if (_top)
+    _top.reset();
+  else if (not _layers.empty())
+    _layers.pop_back();
+}
+
+Values& LayeredValues::top() {
+  if (not _top)
+    _top = make_shared<Values>();
+  else if (_top.use_count() > 1)
+    _top = make_shared<Values>(*_top);
+  return *_top;
+}
+
+// topmost layer that sets d, a default of a parse result only counts if no
+// layer sets it otherwise; all accessors use the same layer
+const Values* LayeredValues::find(const string& d) const {
+  const Values* fallback = 0;
+  for (size_t i = depth(); i > 0; --i) {
+    const Values* v = (i > _layers.size()) ? _top.get() : _layers[i-1].get();
+    if (not v->is_set(d) and not v->_appendMap.count(d) and not v->_numberLists.count(d))
+      continue;
+    if (not v->_parsed or v->is_set_by_user(d))
+      return v;
+    if (not fallback)
+      fallback = v;
+  }
+  return fallback;
+}
+
+const string& LayeredValues::operator[] (const string& d) const {
+  const Values* v = find(d);
+  static const string empty = "";
+  return v ? (*v)[d] : empty;
+}
+
+bool LayeredValues::is_set(const string& d) const {
+  const Values* v = find(d);
+  return v and v->is_set(d);
+}
+
+bool LayeredValues::is_set_by_user(const string& d) const {
+  const Values* v = find(d);
+  return v and v->is_set_by_user(d);
+}
+
+double LayeredValues::number(const string& d) const {
+  const Values* v = find(d);
+  return v ? v->number(d) : 0;
+}
+
+const list<string>& LayeredValues::all(const string& d) const {
+  const Values* v = find(d);
+  static const list<string> empty;
+  return v ? v->all(d) : empty;
+}
+
+const vector<double>& LayeredValues::all_numbers(const string& d) const {
+  const Values* v = find(d);
+  static const vector<double> empty;
+  return v ? v->all_numbers(d) : empty;
+}
+
+// every dest is taken from the layer the accessors use
+Values LayeredValues::flatten() const {
+  set<string> dests;
+  for (size_t i = 0; i < depth(); ++i) {
+    const Values& v = (i == _layers.size()) ? *_top : *_layers[i];
+    for (Values::valMap::const_iterator it = v._map.begin(); it != v._map.end(); ++it)
+      dests.insert(it->first);
+    for (Values::appMap::const_iterator it = v._appendMap.begin(); it != v._appendMap.end(); ++it)
+      dests.insert(it->first);
+    for (Values::numLstMap::const_iterator it = v._numberLists.begin(); it != v._numberLists.end(); ++it)
+      dests.insert(it->first);
+  }
+
+  Values result;
+  for (set<string>::const_iterator d = dests.begin(); d != dests.end(); ++d) {
+    const Values& v = *find(*d);
+    if (v.is_set(*d))
+      result._map[*d] = v[*d];
+    result.is_set_by_user(*d, v.is_set_by_user(*d));
+    Values::appMap::const_iterator lst = v._appendMap.find(*d);
+    if (lst != v._appendMap.end())
+      result._appendMap.insert(*lst);
+    Values::numMap::const_iterator num = v._numbers.find(*d);
+    if (num != v._numbers.end())
+      result._numbers[*d] = num->second;
+    Values::numLstMap::const_iterator nums = v._numberLists.find(*d);
+    if (nums != v._numberLists.end())
+      result._numberLists[*d] = nums->second;
+  }
+  return result;
+}
+////////// } class LayeredValues //////////
+
+////////// class ParseCache { //////////
+static unsigned int fnv1a(const char* p, size_t n) {
+  unsigned int h = 2166136261u;
+  for (size_t i = 0; i < n; ++i) {
+    h ^= static_cast<unsigned char>(p[i]);
+    h *= 16777619u;
+  }
+  return h & 0xffffffffu;
+}
+// arguments are hashed with their length, so that ("ab", "c") != ("a", "bc")
+static unsigned int hash_args(const vector<string>& args) {
+  unsigned int h = 2166136261u;
+  for (vector<string>::const_iterator it = args.begin(); it != args.end(); ++it) {
+    h = (h ^ it->length()) * 16777619u;
+    h = (h ^ fnv1a(it->data(), it->length())) * 16777619u;
+  }
+  return h;
+}
+
+shared_ptr<const ParseResult> ParseCache::parse_args(int argc, char const* const* argv) {
+  const vector<string> args(argv + 1, argv + argc);
+  const unsigned int hash = hash_args(args);
+  shared_ptr<const ParseResult> result = lookup(args, hash);
+  if (result)
+    return result;
+  _parser.parse_args(argc, argv);
+  return insert(args, hash);
+}
+shared_ptr<const ParseResult> ParseCache::parse_args(const vector<string>& args) {
+  const unsigned int hash = hash_args(args);
+  shared_ptr<const ParseResult> result = lookup(args, hash);
+  if (result)
+    return result;
+  _parser.parse_args(args);
+  return insert(args, hash);
+}
+
+shared_ptr<const ParseResult> ParseCache::lookup(const vector<string>& args, unsigned int hash) {
+  typedef multimap<unsigned int, entry_iterator>::const_iterator index_iterator;
+  pair<index_iterator, index_iterator> range = _index.equal_range(hash);
+  for (index_iterator it = range.first; it != range.second; ++it) {
+    if (it->second->args == args) {
+      _lru.splice(_lru.begin(), _lru, it->second);
+      ++_hits;
+      return _lru.front().result;
+    }
+  }
+  ++_misses;
+  return shared_ptr<const ParseResult>();
+}
+
+// called after a successful parse, errors leave the cache unchanged
+shared_ptr<const ParseResult> ParseCache::insert(const vector<string>& args, unsigned int hash) {
+  shared_ptr<ParseResult> result = make_shared<ParseResult>();
+  result->values = _parser._values;
+  result->args.assign(_parser._leftover.begin(), _parser._leftover.end());
+  if (_parser._uncacheable or _capacity == 0)
+    return result;
+
+  Entry entry = { hash, args, result };
+  _lru.push_front(entry);
+  _index.insert(make_pair(hash, _lru.begin()));
+  if (_lru.size() > _capacity) {
+    entry_iterator last = --_lru.end();
+    typedef multimap<unsigned int, entry_iterator>::iterator index_iterator;
+    pair<index_iterator, index_iterator> range = _index.equal_range(last->hash);
+    for (index_iterator it = range.first; it != range.second; ++it) {
+      if (it->second == last) {
+        _index.erase(it);
+        break;
+      }
+    }
+    _lru.erase(last);
+  }
+  return result;
+}
+////////// } class ParseCache //////////
+#endif
+
 }
@@ -7,6 +7,8 @@
 #ifndef OPTIONPARSER_H_
 #define OPTIONPARSER_H_
 
+#include <cstddef>
+#include <new>
 #include <string>
 #include <vector>
 #include <list>
@@ -14,6 +16,12 @@
 #include <set>
 #include <iostream>
 #include <sstream>
+#if __cplusplus >= 201103L
+#include <atomic>
+#include <future>
+#include <memory>
+#include <mutex>
+#endif
 
 namespace optparse {
 
@@ -23,6 +31,94 @@ class Option;
 class Values;
 class Value;
 class Callback;
+class UnitType;
+class ArgumentSink;
+
+//! Monotonic memory resource: memory is only freed, all at once, by release()
+/*!
+ * Blocks come from the buffer given to the constructor first, then from
+ * the global heap.
+ */
+class Arena {
+  public:
+    explicit Arena(size_t block_size = 4096);
+    Arena(void* buffer, size_t size, size_t block_size = 4096);
+    ~Arena() { release(); }
+
+    void* allocate(size_t n);
+    //! Free everything, the Values allocated from the arena are emptied first
+    void release();
+    //! Bytes handed out since the last release()
+    size_t allocated() const { return _allocated; }
+
+  private:
+    Arena(const Arena&);
+    Arena& operator=(const Arena&);
+
+    char* _buffer;
+    size_t _buffer_size;
+    size_t _block_size;
+    void* _blocks;
+    char* _cur;
+    char* _end;
+    size_t _allocated;
+    //! Values allocated from the arena, emptied by release()
+    Values* _values;
+    friend class Values;
+};
+
+//! Allocator using an Arena, or the global heap if the arena is 0
+/*!
+ * With C++11, copies of containers use the global heap, so that they can
+ * outlive the arena (copies of Values always do).
+ */
+template<typename T>
+class ArenaAllocator {
+  public:
+    typedef T value_type;
+    typedef T* pointer;
+    typedef const T* const_pointer;
+    typedef T& reference;
+    typedef const T& const_reference;
+    typedef size_t size_type;
+    typedef std::ptrdiff_t difference_type;
+    template<typename U> struct rebind { typedef ArenaAllocator<U> other; };
+
+    ArenaAllocator(Arena* a = 0) : _arena(a) {}
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : _arena(other.arena()) {}
+
+    pointer allocate(size_type n, const void* = 0) {
+      return static_cast<pointer>(_arena ? _arena->allocate(n * sizeof(T)) : ::operator new(n * sizeof(T)));
+    }
+    void deallocate(pointer p, size_type) {
+      if (not _arena)
+        ::operator delete(p);
+    }
+    size_type max_size() const { return size_type(-1) / sizeof(T); }
+    void construct(pointer p, const T& val) { new (static_cast<void*>(p)) T(val); }
+    void destroy(pointer p) { p->~T(); }
+    pointer address(reference r) const { return &r; }
+    const_pointer address(const_reference r) const { return &r; }
+#if __cplusplus >= 201103L
+    template<typename U, typename... Args>
+    void construct(U* p, Args&&... args) { new (static_cast<void*>(p)) U(std::forward<Args>(args)...); }
+    template<typename U>
+    void destroy(U* p) { p->~U(); }
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+    ArenaAllocator select_on_container_copy_construction() const { return ArenaAllocator(); }
+#endif
+
+    Arena* arena() const { return _arena; }
+
+  private:
+    Arena* _arena;
+};
+template<typename T, typename U>
+bool operator== (const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) { return a.arena() == b.arena(); }
+template<typename T, typename U>
+bool operator!= (const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) { return a.arena() != b.arena(); }
 
 typedef std::map<std::string,std::string> strMap;
 typedef std::map<std::string,std::list<std::string> > lstMap;
@@ -54,28 +150,184 @@ class Value {
 
 class Values {
   public:
-    Values() : _map() {}
+    Values() : _map(), _appendMap(), _userSet(), _numbers(), _numberLists(), _parsed(false),
+      _arena(0), _arena_prev(0), _arena_next(0) {}
+    //! Allocate from a (values returned by parse_args() use OptionParser::arena())
+    /*!
+     * a.release() empties the values, so that they can outlive the arena.
+     */
+    explicit Values(Arena& a);
+    //! Copies use the heap, so that they can outlive the arena of the original
+    Values(const Values& other);
+    ~Values() { unlink(); }
+    Values& operator= (const Values& other) { Values(other).swap(*this); return *this; }
     const std::string& operator[] (const std::string& d) const;
     std::string& operator[] (const std::string& d) { return _map[d]; }
     bool is_set(const std::string& d) const { return _map.find(d) != _map.end(); }
     bool is_set_by_user(const std::string& d) const { return _userSet.find(d) != _userSet.end(); }
     void is_set_by_user(const std::string& d, bool yes);
     Value get(const std::string& d) const { return (is_set(d)) ? Value((*this)[d]) : Value(); }
+    //! Value of a size, duration, percent (or custom unit) option, converted at parse time
+    double number(const std::string& d) const;
+    void number(const std::string& d, double n) { _numbers[d] = n; }
 
     typedef std::list<std::string>::iterator iterator;
     typedef std::list<std::string>::const_iterator const_iterator;
-    std::list<std::string>& all(const std::string& d) { return _appendMap[d]; }
-    const std::list<std::string>& all(const std::string& d) const { return _appendMap.find(d)->second; }
+    std::list<std::string>& all(const std::string& d);
+    const std::list<std::string>& all(const std::string& d) const;
+    //! Converted values of an append option (or positional) of a unit type, in the order of all()
+    std::vector<double>& all_numbers(const std::string& d) { return _numberLists[d]; }
+    const std::vector<double>& all_numbers(const std::string& d) const;
+
+    void swap(Values& other);
+
+    //! Serialize into a compact, versioned binary blob (see PackedValues)
+    std::string pack() const;
 
   private:
-    strMap _map;
-    lstMap _appendMap;
-    std::set<std::string> _userSet;
+    // only the nodes of the maps use the allocator, the strings and the
+    // lists of append options use the heap
+    typedef std::map<std::string, std::string, std::less<std::string>,
+            ArenaAllocator<std::pair<const std::string, std::string> > > valMap;
+    typedef std::map<std::string, std::list<std::string>, std::less<std::string>,
+            ArenaAllocator<std::pair<const std::string, std::list<std::string> > > > appMap;
+    typedef std::set<std::string, std::less<std::string>, ArenaAllocator<std::string> > strSet;
+    typedef std::map<std::string, double, std::less<std::string>,
+            ArenaAllocator<std::pair<const std::string, double> > > numMap;
+    typedef std::map<std::string, std::vector<double>, std::less<std::string>,
+            ArenaAllocator<std::pair<const std::string, std::vector<double> > > > numLstMap;
+
+    void link(Arena* a);
+    void unlink();
+
+    valMap _map;
+    appMap _appendMap;
+    strSet _userSet;
+    numMap _numbers;
+    numLstMap _numberLists;
+    //! Result of parse_args(): values not set by the user are defaults
+    bool _parsed;
+    //! Arena the maps allocate from, and the other values using it
+    Arena* _arena;
+    Values* _arena_prev;
+    Values* _arena_next;
+
+    friend class LayeredValues;
+    friend class OptionParser;
+};
+
+//! Read-only view of a blob created by Values::pack()
+/*!
+ * The blob is queried in place (e.g. from a read-only memory mapping), no
+ * maps are built. The data must stay valid as long as the view is used.
+ */
+class PackedValues {
+  public:
+    PackedValues() : _data(0), _size(0), _count(0) {}
+    PackedValues(const void* data, size_t size);
+
+    bool valid() const { return _data != 0; }
+
+    const char* operator[] (const std::string& d) const;
+    bool is_set(const std::string& d) const;
+    bool is_set_by_user(const std::string& d) const;
+    Value get(const std::string& d) const { return (is_set(d)) ? Value((*this)[d]) : Value(); }
+
+    //! See Values::number()
+    double number(const std::string& d) const;
+    size_t count(const std::string& d) const;
+    const char* all(const std::string& d, size_t i) const;
+    //! The i-th of Values::all_numbers(d), 0 if there is none
+    double all_numbers(const std::string& d, size_t i) const;
+
+    static const unsigned int VERSION = 2;
+
+  private:
+    const char* find(const std::string& d) const;
+    const char* str(size_t off) const;
+
+    const char* _data;
+    size_t _size;
+    size_t _count;
+};
+
+//! Index of words for finding the closest match within a bounded edit distance
+class BKTree {
+  public:
+    BKTree() : _nodes() {}
+    void insert(const std::string& w);
+    size_t size() const { return _nodes.size(); }
+    //! The closest word at most max_dist edits away, "" if there is none
+    std::string closest(const std::string& w, size_t max_dist) const;
+
+  private:
+    struct Node {
+      Node(const std::string& w) : word(w), children() {}
+      std::string word;
+      std::map<size_t,size_t> children;
+    };
+    std::vector<Node> _nodes;
+};
+
+//! INI-style configuration file, see OptionParser::add_config_file()
+/*!
+ * The file is memory-mapped and only the [section] headers are located
+ * when it is opened; the key = value (or key: value) lines of a section
+ * are parsed on first access. Lines before the first header belong to
+ * the section "", lines starting with '#' or ';' are comments. A line
+ * that is neither is returned as an entry with an empty key.
+ */
+class ConfigFile {
+  public:
+    struct Entry {
+      Entry(const std::string& k, const std::string& v, unsigned int l) : key(k), value(v), line(l) {}
+      std::string key;
+      std::string value;
+      unsigned int line;
+    };
+
+    ConfigFile() : _filename(), _data(0), _size(0), _mapped(false), _buffer(), _sections(), _order() {}
+    explicit ConfigFile(const std::string& filename);
+    ~ConfigFile() { close(); }
+
+    //! Returns false if the file cannot be read
+    bool open(const std::string& filename);
+    void close();
+    bool is_open() const { return _data != 0; }
+    const std::string& filename() const { return _filename; }
+
+    const std::vector<std::string>& sections() const { return _order; }
+    bool has_section(const std::string& name) const { return _sections.find(name) != _sections.end(); }
+    const std::list<Entry>& section(const std::string& name) const;
+
+  private:
+    ConfigFile(const ConfigFile&);
+    ConfigFile& operator=(const ConfigFile&);
+
+    struct Section {
+      Section() : bodies(), parsed(false), entries() {}
+      //! Start offset and line number of every body, a section may appear more than once
+      std::vector<std::pair<size_t, unsigned int> > bodies;
+      bool parsed;
+      std::list<Entry> entries;
+    };
+    void index();
+
+    std::string _filename;
+    const char* _data;
+    size_t _size;
+    bool _mapped;
+    std::string _buffer;
+    mutable std::map<std::string, Section> _sections;
+    std::vector<std::string> _order;
 };
 
 class Option {
   public:
     Option(const OptionParser& p) :
+      _parser(&p), _action("store"), _type("string"), _nargs(1), _callback(0) {}
+    //! Option of a parser-independent (shareable) OptionGroup if p is 0
+    Option(const OptionParser* p) :
       _parser(p), _action("store"), _type("string"), _nargs(1), _callback(0) {}
     virtual ~Option() {}
 
@@ -89,34 +341,47 @@ class Option {
     Option& set_const(const std::string& c) { _const = c; return *this; }
     template<typename InputIterator>
     Option& choices(InputIterator begin, InputIterator end) {
-      _choices.assign(begin, end); type("choice"); return *this;
+      _choices.assign(begin, end); index_choices(); type("choice"); return *this;
     }
 #if __cplusplus >= 201103L
     Option& choices(std::initializer_list<std::string> ilist) {
-      _choices.assign(ilist); type("choice"); return *this;
+      _choices.assign(ilist); index_choices(); type("choice"); return *this;
     }
 #endif
     Option& help(const std::string& h) { _help = h; return *this; }
     Option& metavar(const std::string& m) { _metavar = m; return *this; }
     Option& callback(Callback& c) { _callback = &c; return *this; }
+    //! Take the value from environment variable e if not given on the command line
+    /*!
+     * Flags and const actions are switched on by any value except "", "0",
+     * "false", "no" and "off" (flags are switched off by those), a count is
+     * set to the value.
+     */
+    Option& env(const std::string& e) { _env = e; return *this; }
 
     const std::string& action() const { return _action; }
     const std::string& type() const { return _type; }
     const std::string& dest() const { return _dest; }
-    const std::string& get_default() const;
+    const std::string& get_default() const { return get_default(0); }
     size_t nargs() const { return _nargs; }
     const std::string& get_const() const { return _const; }
     const std::list<std::string>& choices() const { return _choices; }
     const std::string& help() const { return _help; }
     const std::string& metavar() const { return _metavar; }
     Callback* callback() const { return _callback; }
+    const std::string& env() const { return _env; }
 
   private:
-    std::string check_type(const std::string& opt, const std::string& val) const;
+    // parser 0 means the parser the option was created with
+    const std::string& get_default(const OptionParser* parser) const;
+    std::string check_type(const OptionParser& parser, const std::string& opt, const std::string& val,
+        double* number = 0) const;
+    std::string check_value(const OptionParser& parser, const std::string& val, double* number) const;
     std::string format_option_help(unsigned int indent = 2) const;
-    std::string format_help(unsigned int indent = 2) const;
+    std::string format_help(const OptionParser* parser, unsigned int indent = 2) const;
+    void index_choices();
 
-    const OptionParser& _parser;
+    const OptionParser* _parser;
 
     std::set<std::string> _short_opts;
     std::set<std::string> _long_opts;
@@ -131,14 +396,57 @@ class Option {
     std::string _help;
     std::string _metavar;
     Callback* _callback;
+    std::string _env;
+    BKTree _choice_index;
 
     friend class OptionContainer;
     friend class OptionParser;
 };
 
+//! Declared positional argument, filled from the leftover arguments
+/*!
+ * Besides the option types, "existing_file" and "directory" are useful
+ * here. Large numbers of arguments are validated by several threads
+ * (with C++11), so custom UnitType objects must be thread-safe.
+ */
+class Positional {
+  public:
+    Positional(const OptionParser& p, const std::string& name) :
+      _option(p), _name(name), _min(1), _max(1) { _option.dest(name); }
+
+    Positional& type(const std::string& t) { _option.type(t); return *this; }
+    Positional& dest(const std::string& d) { _option.dest(d); return *this; }
+    template<typename InputIterator>
+    Positional& choices(InputIterator begin, InputIterator end) { _option.choices(begin, end); return *this; }
+    //! Exactly n arguments
+    Positional& nargs(size_t n) { _min = _max = n; return *this; }
+    //! Between min and max arguments, max may be UNLIMITED
+    Positional& nargs(size_t min, size_t max) {
+      if (min > max)
+        throw "positional nargs: min > max";
+      _min = min; _max = max; return *this;
+    }
+
+    const std::string& name() const { return _name; }
+    const std::string& type() const { return _option.type(); }
+    const std::string& dest() const { return _option.dest(); }
+    size_t min_args() const { return _min; }
+    size_t max_args() const { return _max; }
+
+    static const size_t UNLIMITED = static_cast<size_t>(-1);
+
+  private:
+    Option _option;
+    std::string _name;
+    size_t _min;
+    size_t _max;
+
+    friend class OptionParser;
+};
+
 class OptionContainer {
   public:
-    OptionContainer(const std::string& d = "") : _description(d) {}
+    OptionContainer(const std::string& d = "") : _description(d), _generation(0), _frozen(false) {}
     virtual ~OptionContainer() {}
 
     virtual OptionContainer& description(const std::string& d) { _description = d; return *this; }
@@ -152,16 +460,225 @@ class OptionContainer {
     std::string format_option_help(unsigned int indent = 2) const;
 
   protected:
+    std::string format_option_help(const OptionParser* parser, unsigned int indent) const;
+
     std::string _description;
 
     std::list<Option> _opts;
     optMap _optmap_s;
     optMap _optmap_l;
+    //! Changed whenever options are added, see OptionParser::suggest_long_opt()
+    unsigned long _generation;
+    //! Set when a group is added to a parser, add_option() throws from then on
+    mutable bool _frozen;
 
   private:
-    virtual const OptionParser& get_parser() = 0;
+    virtual const OptionParser* get_parser() = 0;
 };
 
+//! Group of options for the help output
+/*!
+ * A group created without a parser can be added to any number of parsers.
+ * They share the options and lookup tables of the group, so it is frozen
+ * when it is first added: add_option() throws from then on (with C++11 it
+ * can be passed as std::shared_ptr<const OptionGroup>).
+ */
+class OptionGroup : public OptionContainer {
+  public:
+    OptionGroup(const OptionParser& p, const std::string& t, const std::string& d = "") :
+      OptionContainer(d), _parser(&p), _title(t) {}
+    OptionGroup(const std::string& t, const std::string& d = "") :
+      OptionContainer(d), _parser(0), _title(t) {}
+    virtual ~OptionGroup() {}
+
+    OptionGroup& title(const std::string& t) { _title = t; return *this; }
+    const std::string& title() const { return _title; }
+
+  private:
+    const OptionParser* get_parser() { return _parser; }
+
+    const OptionParser* _parser;
+    std::string _title;
+
+  friend class OptionParser;
+};
+
+//! Entry of a constant option table, see StaticSchema
+/*!
+ * Null (or missing) members mean the same as not calling the setter of
+ * Option: no short or long name, action "store", type "string", dest
+ * derived from the names, no default, help, metavar or const.
+ */
+struct StaticOption {
+#if __cplusplus >= 201103L
+  constexpr StaticOption(char s, const char* l = 0, const char* a = 0, const char* t = 0, const char* d = 0,
+      const char* def = 0, const char* h = 0, const char* m = 0, const char* c = 0) :
+    short_opt(s), long_opt(l), action(a), type(t), dest(d), default_value(def), help(h), metavar(m), const_value(c) {}
+#endif
+  char short_opt;
+  const char* long_opt;
+  const char* action;
+  const char* type;
+  const char* dest;
+  const char* default_value;
+  const char* help;
+  const char* metavar;
+  const char* const_value;
+};
+
+#if __cplusplus >= 201103L
+template<size_t... I> struct IndexList {};
+template<typename A, typename B> struct ConcatIndexList;
+template<size_t... I, size_t... J> struct ConcatIndexList<IndexList<I...>, IndexList<J...> > {
+  typedef IndexList<I..., (sizeof...(I) + J)...> type;
+};
+// halves, so that the depth of template instantiation is logarithmic
+template<size_t N> struct MakeIndexList :
+  ConcatIndexList<typename MakeIndexList<N/2>::type, typename MakeIndexList<N - N/2>::type> {};
+template<> struct MakeIndexList<0> { typedef IndexList<> type; };
+template<> struct MakeIndexList<1> { typedef IndexList<0> type; };
+
+//! Option table with lookup indexes computed at compile time
+/*!
+ *   constexpr optparse::StaticOption options[] = {
+ *     { 'v', "verbose", "store_true", 0, 0, 0, "be verbose" },
+ *     { 'o', "output", 0, 0, 0, "a.out", "write to FILE", "FILE" },
+ *   };
+ *   constexpr auto schema = optparse::make_static_schema(options);
+ *   optparse::OptionParser parser;
+ *   parser.add_static_options(schema);
+ *
+ * The long names are indexed in sorted order (abbreviations are found by
+ * binary search), short names (7-bit characters) in a table indexed by the
+ * character. A duplicate long or short name is a compile error. The parser
+ * only creates Option objects for the options that are used, see
+ * OptionParser::add_static_options().
+ *
+ * With C++14 the names are sorted by a loop (O(N log N) steps); C++11 only
+ * allows recursion, which compares all pairs of names and so exceeds the
+ * compilers' limits on constexpr evaluation for more than a few hundred
+ * options.
+ */
+template<size_t N>
+class StaticSchema {
+  public:
+#if __cplusplus >= 201402L
+    constexpr StaticSchema(const StaticOption (&o)[N]) : _options(o), _by_long(), _long_count(0), _by_short() {
+      for (size_t i = 0; i < N; ++i)
+        if (o[i].long_opt)
+          _by_long[_long_count++] = i;
+      // bottom-up merge sort
+      unsigned short tmp[N] = {};
+      for (size_t width = 1; width < _long_count; width *= 2) {
+        for (size_t lo = 0; lo < _long_count; lo += 2 * width) {
+          const size_t mid = (lo + width < _long_count) ? lo + width : _long_count;
+          const size_t hi = (lo + 2 * width < _long_count) ? lo + 2 * width : _long_count;
+          for (size_t a = lo, b = mid, k = lo; k < hi; ++k)
+            tmp[k] = (a < mid and (b == hi or not less(o[_by_long[b]].long_opt, o[_by_long[a]].long_opt))) ?
+              _by_long[a++] : _by_long[b++];
+        }
+        for (size_t k = 0; k < _long_count; ++k)
+          _by_long[k] = tmp[k];
+      }
+      for (size_t k = 1; k < _long_count; ++k)
+        if (not less(o[_by_long[k-1]].long_opt, o[_by_long[k]].long_opt))
+          throw "duplicate long option";
+      for (size_t k = _long_count; k < N; ++k)
+        _by_long[k] = N;
+
+      for (size_t c = 0; c < 128; ++c)
+        _by_short[c] = N;
+      for (size_t i = 0; i < N; ++i) {
+        const size_t c = static_cast<size_t>(o[i].short_opt);
+        if (c == 0 or c >= 128)
+          continue;
+        if (_by_short[c] != N)
+          throw "duplicate short option";
+        _by_short[c] = i;
+      }
+    }
+#else
+    constexpr StaticSchema(const StaticOption (&o)[N]) :
+      StaticSchema(o, typename MakeIndexList<N>::type(), typename MakeIndexList<128>::type()) {}
+#endif
+
+    constexpr const StaticOption* options() const { return _options; }
+    constexpr const unsigned short* by_long() const { return _by_long; }
+    constexpr size_t long_count() const { return _long_count; }
+    constexpr const unsigned short* by_short() const { return _by_short; }
+
+  private:
+    // strings are ordered like std::string
+    static constexpr bool less(const char* a, const char* b) {
+      return (*a == *b) ? (*a != 0 and less(a + 1, b + 1)) : static_cast<unsigned char>(*a) < static_cast<unsigned char>(*b);
+    }
+
+#if __cplusplus < 201402L
+    //! Position of every option in the order of the long names
+    struct Ranks {
+      template<size_t... I>
+      constexpr Ranks(const StaticOption* o, IndexList<I...>) : r{ rank(o, I, 0, N)... } {}
+      size_t r[N];
+    };
+
+    template<size_t... I, size_t... C>
+    constexpr StaticSchema(const StaticOption (&o)[N], IndexList<I...> i, IndexList<C...> c) :
+      StaticSchema(o, Ranks(o, i), i, c) {}
+    template<size_t... I, size_t... C>
+    constexpr StaticSchema(const StaticOption (&o)[N], const Ranks& ranks, IndexList<I...>, IndexList<C...>) :
+      _options(o), _by_long{ long_at(o, ranks, I)... }, _long_count(count_long(o, 0, N)),
+      _by_short{ short_at(o, C)... } {}
+
+    // the following recurse into halves of [lo, hi), so that the depth of
+    // constexpr evaluation stays logarithmic in N
+    static constexpr size_t count_long(const StaticOption* o, size_t lo, size_t hi) {
+      return (hi - lo == 0) ? 0 : (hi - lo == 1) ? (o[lo].long_opt ? 1 : 0) :
+        count_long(o, lo, lo + (hi - lo) / 2) + count_long(o, lo + (hi - lo) / 2, hi);
+    }
+    // number of long names in [lo, hi) before that of option i
+    static constexpr size_t rank(const StaticOption* o, size_t i, size_t lo, size_t hi) {
+      return (not o[i].long_opt or hi - lo == 0) ? 0 :
+        (hi - lo == 1) ? ((o[lo].long_opt and less(o[lo].long_opt, o[i].long_opt)) ? 1 : 0) :
+        rank(o, i, lo, lo + (hi - lo) / 2) + rank(o, i, lo + (hi - lo) / 2, hi);
+    }
+    static constexpr size_t first(size_t a, size_t b) { return (a != N) ? a : b; }
+    // index of the option in [lo, hi) with the k-th long name, N if there is none
+    static constexpr size_t find_rank(const StaticOption* o, const Ranks& ranks, size_t k, size_t lo, size_t hi) {
+      return (hi - lo == 0) ? N : (hi - lo == 1) ? ((o[lo].long_opt and ranks.r[lo] == k) ? lo : N) :
+        first(find_rank(o, ranks, k, lo, lo + (hi - lo) / 2), find_rank(o, ranks, k, lo + (hi - lo) / 2, hi));
+    }
+    // a duplicate name leaves a gap in the ranks
+    static constexpr unsigned short check_long(size_t i, size_t k, size_t count) {
+      return (i == N and k < count) ? throw "duplicate long option" : i;
+    }
+    static constexpr unsigned short long_at(const StaticOption* o, const Ranks& ranks, size_t k) {
+      return check_long(find_rank(o, ranks, k, 0, N), k, count_long(o, 0, N));
+    }
+    static constexpr size_t count_short(const StaticOption* o, size_t c, size_t lo, size_t hi) {
+      return (hi - lo == 0) ? 0 : (hi - lo == 1) ? ((static_cast<size_t>(o[lo].short_opt) == c) ? 1 : 0) :
+        count_short(o, c, lo, lo + (hi - lo) / 2) + count_short(o, c, lo + (hi - lo) / 2, hi);
+    }
+    static constexpr size_t find_short(const StaticOption* o, size_t c, size_t lo, size_t hi) {
+      return (hi - lo == 0) ? N : (hi - lo == 1) ? ((static_cast<size_t>(o[lo].short_opt) == c) ? lo : N) :
+        first(find_short(o, c, lo, lo + (hi - lo) / 2), find_short(o, c, lo + (hi - lo) / 2, hi));
+    }
+    static constexpr unsigned short short_at(const StaticOption* o, size_t c) {
+      return (c == 0) ? N : (count_short(o, c, 0, N) > 1) ? throw "duplicate short option" : find_short(o, c, 0, N);
+    }
+#endif
+
+    const StaticOption* _options;
+    unsigned short _by_long[N];
+    size_t _long_count;
+    unsigned short _by_short[128];
+};
+
+template<size_t N>
+constexpr StaticSchema<N> make_static_schema(const StaticOption (&o)[N]) {
+  return StaticSchema<N>(o);
+}
+#endif
+
 class OptionParser : public OptionContainer {
   public:
     OptionParser();
@@ -181,7 +698,62 @@ class OptionParser : public OptionContainer {
     OptionParser& set_defaults(const std::string& dest, T t) { std::ostringstream ss; ss << t; _defaults[dest] = ss.str(); return *this; }
     OptionParser& enable_interspersed_args() { _interspersed_args = true; return *this; }
     OptionParser& disable_interspersed_args() { _interspersed_args = false; return *this; }
+    //! Bind every dest to the environment variable prefix + DEST (upper case)
+    /*!
+     * The value is stored like that of a store, append or count option of
+     * the dest (a count must be a number); dests that only have flags are
+     * set to 1, or to 0 by "", "0", "false", "no" and "off". Dests that
+     * only have const actions or callbacks are not bound.
+     */
+    OptionParser& env_prefix(const std::string& p) { _env_prefix = p; return *this; }
+    //! Suggest close matches for unknown options and invalid choices
+    OptionParser& suggest_on_error(bool s) { _suggest_on_error = s; return *this; }
+    //! Make t available as Option::type(name), overriding built-in types of the same name
+    OptionParser& add_unit_type(const std::string& name, const UnitType& t) { _unit_types[name] = &t; return *this; }
+    //! Allocate the values and args() of the following parses from a (0: the heap)
+    /*!
+     * Drops the results of the previous parse. Releasing a empties the
+     * values of the parses made since its last release.
+     */
+    OptionParser& arena(Arena* a);
+    //! Pass positional arguments to s as they are found instead of collecting them for args()
+    OptionParser& args_sink(ArgumentSink& s) { _args_sink = &s; return *this; }
+    //! Declare the next positional argument (not used together with args_sink())
+    Positional& add_positional(const std::string& name) {
+      _positionals.push_back(Positional(*this, name)); return _positionals.back();
+    }
     OptionParser& add_option_group(const OptionGroup& group);
+    //! Read option values from a section of f for options not given on the command line or in the environment
+    /*!
+     * Keys are long option names (without "--") or dests. Values are taken
+     * like those of environment variables (see env() and env_prefix()).
+     * Files added later take precedence; f must stay open while the parser
+     * is used.
+     */
+    OptionParser& add_config_file(const ConfigFile& f, const std::string& section = "") {
+      _config_files.push_back(std::make_pair(&f, section)); return *this;
+    }
+#if __cplusplus >= 201103L
+    //! Use the options of a compile-time table, in addition to add_option()
+    /*!
+     * An Option object is only created when an option is given on the
+     * command line (all of them for help output, env_prefix() and config
+     * files with keys that are dests). s must outlive the parser.
+     */
+    template<size_t N>
+    OptionParser& add_static_options(const StaticSchema<N>& s) {
+      _tables.push_back(OptionTable());
+      OptionTable& t = _tables.back();
+      t.options = s.options(); t.size = N;
+      t.by_long = s.by_long(); t.long_count = s.long_count();
+      t.by_short = s.by_short();
+      _generation++;
+      return *this;
+    }
+    OptionParser& add_option_group(std::shared_ptr<const OptionGroup> group) {
+      _shared_groups.push_back(group); return add_option_group(*group);
+    }
+#endif
 
     const std::string& usage() const { return _usage; }
     const std::string& version() const { return _version; }
@@ -191,6 +763,9 @@ class OptionParser : public OptionContainer {
     const std::string& prog() const { return _prog; }
     const std::string& epilog() const { return _epilog; }
     bool interspersed_args() const { return _interspersed_args; }
+    const std::string& env_prefix() const { return _env_prefix; }
+    bool suggest_on_error() const { return _suggest_on_error; }
+    Arena* arena() const { return _arena; }
 
     Values& parse_args(int argc, char const* const* argv);
     Values& parse_args(const std::vector<std::string>& args);
@@ -219,15 +794,58 @@ class OptionParser : public OptionContainer {
     void error(const std::string& msg) const;
     void exit() const;
 
+    //! Export options, groups, positionals, defaults and settings into a relocatable blob
+    /*!
+     * Call before parse_args(). Callbacks are not exported, callback options
+     * are restored without one. The blob contains the lookup indexes, so
+     * that load_schema() does not need to build them.
+     */
+    std::string dump_schema() const;
+    //! Add the contents of a blob created by dump_schema()
+    /*!
+     * The options are used in place, like those of add_static_options(), so
+     * the data (e.g. a read-only memory mapping) must stay valid as long as
+     * the parser is used. Returns false (leaving the parser unchanged) if
+     * the schema version or checksum does not match.
+     */
+    bool load_schema(const void* data, size_t size);
+
+    static const unsigned int SCHEMA_VERSION = 4;
+
   private:
-    const OptionParser& get_parser() { return *this; }
+    const OptionParser* get_parser() { return this; }
     const Option& lookup_short_opt(const std::string& opt) const;
     const Option& lookup_long_opt(const std::string& opt) const;
+    struct OptionTable;
+    const Option* find_table_long(const std::string& opt) const;
+    const Option& table_option(const OptionTable& t, size_t i) const;
+    void materialize_tables() const;
+    unsigned long options_generation() const;
+    void container_options(const OptionGroup* group, std::vector<Option const*>& opts) const;
 
-    void handle_short_opt(const std::string& opt, const std::string& arg);
+    Values& parse();
+    bool has_next_arg() const;
+    std::string next_arg();
+    void add_leftover(const std::string& arg);
+
+    void handle_short_opt(const std::string& arg);
     void handle_long_opt(const std::string& optstr);
 
-    void process_opt(const Option& option, const std::string& opt, const std::string& value);
+    void process_opt(const Option& option, const std::string& opt, const std::string& value,
+        const std::string& where = "");
+    void process_value(const Option& o, const std::string& name, const std::string& value, bool by_dest,
+        const std::string& where);
+    void bind_env();
+    void process_env();
+    void process_config_files();
+    void process_positionals();
+    void set_default_values(const std::list<Option>& opts);
+    void set_table_default_values();
+    const UnitType* unit_type(const std::string& name) const;
+    std::string suggest_long_opt(const std::string& opt) const;
+#if __cplusplus >= 201103L
+    void join_async_callbacks(bool report) const;
+#endif
 
     std::string format_usage(const std::string& u) const;
 
@@ -238,41 +856,244 @@ class OptionParser : public OptionContainer {
     std::string _prog;
     std::string _epilog;
     bool _interspersed_args;
+    std::string _env_prefix;
+    bool _suggest_on_error;
+    std::map<std::string, UnitType const*> _unit_types;
+    ArgumentSink* _args_sink;
+    Arena* _arena;
+    std::list<Positional> _positionals;
+    std::list<std::pair<ConfigFile const*, std::string> > _config_files;
+    mutable BKTree _long_index;
+    mutable unsigned long _long_index_generation;
+    //! Variable name -> option and whether it is bound by dest, see process_env()
+    std::map<std::string, std::pair<Option const*, bool> > _env_bound;
+    unsigned long _env_bound_generation;
+    std::string _env_bound_prefix;
+
+    //! Options of a compile-time table or a container of a loaded schema
+    /*!
+     * They are only turned into Option objects when used, see table_option().
+     */
+    struct OptionTable {
+      OptionTable() : options(0), by_long(0), by_short(0), blob(0), blob_size(0), records(0), long_index(0),
+        short_index(0), env_count(0), size(0), long_count(0), group(0), cache() {}
+
+      // add_static_options()
+      const StaticOption* options;
+      const unsigned short* by_long;
+      const unsigned short* by_short;
+      // load_schema(), offsets into the blob
+      const char* blob;
+      size_t blob_size;
+      size_t records;
+      size_t long_index;
+      size_t short_index;
+      size_t env_count;
+
+      size_t size;
+      size_t long_count;
+      //! Help section, 0 for the options of the parser itself
+      const OptionGroup* group;
+      mutable std::vector<Option const*> cache;
+
+      //! The k-th long name in sorted order and the index of its option
+      const char* long_name(size_t k) const;
+      size_t long_option(size_t k) const;
+      //! Index of the option, size if there is none
+      size_t short_option(unsigned char c) const;
+      size_t find_long(const std::string& opt) const;
+
+      std::string dest(size_t i) const;
+      const char* type(size_t i) const;
+      const char* default_value(size_t i) const;
+    };
+    std::list<OptionTable> _tables;
+    mutable std::list<Option> _table_opts;
 
     Values _values;
 
     strMap _defaults;
     std::list<OptionGroup const*> _groups;
+    std::list<OptionGroup> _schema_groups;
+#if __cplusplus >= 201103L
+    std::list<std::shared_ptr<const OptionGroup> > _shared_groups;
+    mutable std::list<std::pair<std::string, std::shared_future<void> > > _async_callbacks;
+#endif
 
-    std::list<std::string> _remaining;
+    char const* const* _argv_next;
+    char const* const* _argv_end;
+    const std::string* _args_next;
+    const std::string* _args_end;
     std::list<std::string> _leftover;
 
+    //! The last parse depended on more than the arguments or had side effects
+    bool _uncacheable;
+
     friend class Option;
+    friend class ParseCache;
 };
 
-class OptionGroup : public OptionContainer {
+class Callback {
+public:
+  virtual void operator() (const Option& option, const std::string& opt, const std::string& val, const OptionParser& parser) = 0;
+  virtual ~Callback() {}
+};
+
+class ArgumentSink {
+public:
+  virtual void operator() (const std::string& arg, const OptionParser& parser) = 0;
+  virtual ~ArgumentSink() {}
+};
+
+//! Converter for option types with units, see OptionParser::add_unit_type()
+class UnitType {
+public:
+  //! Return false if val is invalid, otherwise store its numeric value in result
+  virtual bool operator() (const std::string& val, double& result) const = 0;
+  virtual ~UnitType() {}
+};
+
+#if __cplusplus >= 201103L
+//! Callback that runs concurrently with the rest of parse_args()
+/*!
+ * parse_args() waits for all of them before it returns or reports an
+ * error. Failures are reported by throwing an std::exception, the first
+ * one in argument order is passed to OptionParser::error(), before any
+ * error of a later argument. The callback must not access the values
+ * being parsed or call OptionParser::error().
+ */
+class AsyncCallback : public Callback {};
+
+class ChangeListener {
+public:
+  virtual void operator() (const std::string& dest, const Values& old_values, const Values& new_values) = 0;
+  virtual ~ChangeListener() {}
+};
+
+//! Configuration that can be re-parsed while other threads read it
+/*!
+ * Every reload() parses into a new immutable snapshot which is published
+ * atomically; get() is a single atomic load. Replaced snapshots stay valid
+ * until collect() is called, which must only happen once no reader can
+ * still hold a reference to one of them (e.g. after all worker threads
+ * passed a quiescent point).
+ */
+class ReloadableValues {
   public:
-    OptionGroup(const OptionParser& p, const std::string& t, const std::string& d = "") :
-      OptionContainer(d), _parser(p), _title(t) {}
-    virtual ~OptionGroup() {}
+    ReloadableValues(OptionParser& p) : _parser(p), _current(new Values()) {}
+    ~ReloadableValues();
+    ReloadableValues(const ReloadableValues&) = delete;
+    ReloadableValues& operator=(const ReloadableValues&) = delete;
 
-    OptionGroup& title(const std::string& t) { _title = t; return *this; }
-    const std::string& title() const { return _title; }
+    const Values& get() const { return *_current.load(std::memory_order_acquire); }
+
+    const Values& reload(int argc, char const* const* argv);
+    const Values& reload(const std::vector<std::string>& args);
+
+    //! Call l after a reload() changed the value(s) of dest
+    ReloadableValues& on_change(const std::string& dest, ChangeListener& l);
+
+    void collect();
 
   private:
-    const OptionParser& get_parser() { return _parser; }
+    const Values& publish(const Values& values);
 
-    const OptionParser& _parser;
-    std::string _title;
+    OptionParser& _parser;
+    std::atomic<const Values*> _current;
+    std::vector<const Values*> _retired;
+    std::multimap<std::string, ChangeListener*> _listeners;
+    std::mutex _mutex;
+};
 
-  friend class OptionParser;
+//! Stack of Values where each dest is resolved from the topmost layer setting it
+/*!
+ * Layers are shared, not copied: push() and copying a LayeredValues only
+ * copy pointers. Writes go through top(), which copies the topmost layer
+ * first if it is still shared, so a per-request override costs time
+ * proportional to the overridden dests only.
+ */
+class LayeredValues {
+  public:
+    LayeredValues() : _layers(), _top() {}
+
+    //! Add an immutable layer on top, e.g. defaults, config files, the result of parse_args()
+    /*!
+     * The defaults in a result of parse_args() (values not set by the
+     * user) only count if no layer sets the dest otherwise.
+     */
+    LayeredValues& push(std::shared_ptr<const Values> layer);
+    LayeredValues& push(const Values& layer) { return push(std::make_shared<const Values>(layer)); }
+    void pop();
+    size_t depth() const { return _layers.size() + (_top ? 1 : 0); }
+
+    //! Writable topmost layer, added if the top is an immutable layer
+    Values& top();
+
+    const std::string& operator[] (const std::string& d) const;
+    bool is_set(const std::string& d) const;
+    bool is_set_by_user(const std::string& d) const;
+    Value get(const std::string& d) const { return (is_set(d)) ? Value((*this)[d]) : Value(); }
+    double number(const std::string& d) const;
+    const std::list<std::string>& all(const std::string& d) const;
+    const std::vector<double>& all_numbers(const std::string& d) const;
+
+    //! Merge all layers into a single Values
+    Values flatten() const;
+
+  private:
+    const Values* find(const std::string& d) const;
+
+    std::vector<std::shared_ptr<const Values> > _layers;
+    std::shared_ptr<Values> _top;
 };
 
-class Callback {
-public:
-  virtual void operator() (const Option& option, const std::string& opt, const std::string& val, const OptionParser& parser) = 0;
-  virtual ~Callback() {}
+//! Values and positional arguments of one parse
+struct ParseResult {
+  Values values;
+  std::vector<std::string> args;
+};
+
+//! Bounded LRU cache of the results of a parser, keyed by the argument vector
+/*!
+ * A hit returns the shared result of an earlier parse without parsing
+ * again. Results are not cached if the parse called a callback or the
+ * help or version action, read the environment or config files, passed
+ * arguments to an ArgumentSink, or checked the file system (an option or
+ * positional of type "existing_file" or "directory" was given). Like the
+ * parser, the cache must not be used by several threads at once.
+ */
+class ParseCache {
+  public:
+    ParseCache(OptionParser& p, size_t capacity = 256) :
+      _parser(p), _capacity(capacity), _lru(), _index(), _hits(0), _misses(0) {}
+
+    std::shared_ptr<const ParseResult> parse_args(int argc, char const* const* argv);
+    std::shared_ptr<const ParseResult> parse_args(const std::vector<std::string>& args);
+
+    size_t hits() const { return _hits; }
+    size_t misses() const { return _misses; }
+    size_t size() const { return _lru.size(); }
+    void clear() { _lru.clear(); _index.clear(); }
+
+  private:
+    struct Entry {
+      unsigned int hash;
+      std::vector<std::string> args;
+      std::shared_ptr<const ParseResult> result;
+    };
+    typedef std::list<Entry>::iterator entry_iterator;
+
+    std::shared_ptr<const ParseResult> lookup(const std::vector<std::string>& args, unsigned int hash);
+    std::shared_ptr<const ParseResult> insert(const std::vector<std::string>& args, unsigned int hash);
+
+    OptionParser& _parser;
+    size_t _capacity;
+    std::list<Entry> _lru;
+    std::multimap<unsigned int, entry_iterator> _index;
+    size_t _hits;
+    size_t _misses;
 };
+#endif
 
 }
 
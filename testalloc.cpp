@@ -0,0 +1,195 @@
+/**
+ * Allocation budgets for the parse and help paths.
+ *
+ * Replaces the global operator new/delete to count heap allocations per
+ * operation, run on a schema similar to the one in testprog.cpp. Exits
+ * with status 1 if an operation exceeds its budget.
+ */
+
+#include "OptionParser.h"
+
+#include <cstdlib>
+#include <cstdio>
+#include <new>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+using namespace optparse;
+
+static bool counting = false;
+static size_t allocations = 0;
+static size_t bytes = 0;
+
+#if __cplusplus >= 201103L
+# define THROW_BAD_ALLOC
+# define NOTHROW noexcept
+#else
+# define THROW_BAD_ALLOC throw(std::bad_alloc)
+# define NOTHROW throw()
+#endif
+
+// all operators go through these two, which are not inlined: otherwise gcc
+// sees the free() of an inlined operator delete paired with operator new
+// and warns (-Wmismatched-new-delete)
+#if defined(__GNUC__)
+__attribute__((noinline))
+#endif
+static void* counted_malloc(size_t n) {
+  if (counting) {
+    allocations++;
+    bytes += n;
+  }
+  return malloc(n ? n : 1);
+}
+#if defined(__GNUC__)
+__attribute__((noinline))
+#endif
+static void counted_free(void* p) {
+  free(p);
+}
+
+void* operator new(size_t n) THROW_BAD_ALLOC {
+  void* p = counted_malloc(n);
+  if (not p)
+    throw std::bad_alloc();
+  return p;
+}
+void* operator new[](size_t n) THROW_BAD_ALLOC {
+  return operator new(n);
+}
+void operator delete(void* p) NOTHROW {
+  counted_free(p);
+}
+void operator delete[](void* p) NOTHROW {
+  counted_free(p);
+}
+#if __cpp_sized_deallocation
+void operator delete(void* p, size_t) NOTHROW {
+  counted_free(p);
+}
+void operator delete[](void* p, size_t) NOTHROW {
+  counted_free(p);
+}
+#endif
+
+static void build(OptionParser& parser, OptionGroup& group) {
+  parser.usage("usage: %prog [OPTION]... DIR [FILE]...")
+    .version("%prog 1.0")
+    .description("Lorem ipsum dolor sit amet, consectetur adipisicing elit, sed do eiusmod"
+        " tempor incididunt ut labore et dolore magna aliqua.")
+    .epilog("Sed ut perspiciatis unde omnis iste natus error sit voluptatem.");
+  parser.set_defaults("verbosity", "50");
+  parser.set_defaults("no_clear", "0");
+
+  parser.add_option("--clear") .action("store_false") .dest("no_clear") .help("clear (default)");
+  parser.add_option("--no-clear") .action("store_true") .help("not clear");
+  parser.add_option("--string")
+    .help("This is a really long text... very long indeed! It must be wrapped on normal terminals.");
+  parser.add_option("-x", "--clause", "--sentence") .metavar("SENTENCE") .set_default("I'm a sentence");
+  parser.add_option("-k") .action("count") .help("how many times?");
+  parser.add_option("--verbose") .action("store_const") .set_const("100") .dest("verbosity");
+  parser.add_option("-s", "--silent") .action("store_const") .set_const("0") .dest("verbosity");
+  parser.add_option("-n", "--number") .type("int") .set_default("1") .metavar("NUM")
+    .help("number of files (default: %default)");
+  parser.add_option("-i", "--int") .action("store") .type("int") .set_default(3) .help("default: %default");
+  parser.add_option("-f", "--float") .action("store") .type("float") .set_default(5.3);
+  char const* const choices[] = { "foo", "bar", "baz" };
+  parser.add_option("-C", "--choices") .choices(&choices[0], &choices[3]);
+  parser.add_option("-m", "--more") .action("append");
+  parser.add_option("--more-milk") .action("append_const") .set_const("milk");
+  parser.add_option("--cache") .type("size") .set_default("64MiB");
+
+  group.add_option("-g") .action("store_true") .help("Group option.") .set_default("0");
+  group.add_option("-w", "--width") .action("store") .type("int") .set_default(640);
+  parser.add_option_group(group);
+}
+
+struct Result {
+  const char* name;
+  size_t allocations;
+  size_t bytes;
+  size_t budget;
+};
+
+static Result measure(const char* name, OptionParser& parser, const vector<string>& args, size_t budget) {
+  parser.parse_args(args);  // warm up (adds --help and --version once)
+  allocations = bytes = 0;
+  counting = true;
+  parser.parse_args(args);
+  counting = false;
+  Result r = { name, allocations, bytes, budget };
+  return r;
+}
+
+int main()
+{
+  // budgets are allocation counts, about twice what libstdc++ needs
+  OptionParser parser;
+  parser.prog("testalloc");
+  OptionGroup group(parser, "Group");
+
+  allocations = bytes = 0;
+  counting = true;
+  build(parser, group);
+  counting = false;
+  Result construct = { "construct schema", allocations, bytes, 220 };
+
+  vector<Result> results;
+  results.push_back(construct);
+
+  vector<string> none;
+  results.push_back(measure("parse_args (no arguments)", parser, none, 30));
+
+  const char* const typical[] = { "--no-clear", "foo", "bar", "-k", "-k", "z", "-n3", "x y",
+    "-i", "8", "-f", "3.2", "--cache=4K", "-m", "a", "--more=b", "--cho", "baz", "-g" };
+  vector<string> args(&typical[0], &typical[sizeof(typical) / sizeof(typical[0])]);
+  results.push_back(measure("parse_args (typical command line)", parser, args, 90));
+
+  // the nodes of the value maps come from the arena, args() and the lists
+  // of append options from the heap
+  char buffer[8192];
+  Arena arena(buffer, sizeof(buffer));
+  parser.arena(&arena);
+  results.push_back(measure("parse_args (typical, into an Arena)", parser, args, 48));
+  parser.arena(0);
+
+  // a large schema: the parse must not do work per option when no
+  // environment variable, config file or default is involved
+  OptionParser large;
+  large.prog("testalloc");
+  for (int i = 0; i < 800; ++i) {
+    char name[16];
+    sprintf(name, "--o%d", i);
+    large.add_option(name);
+  }
+  results.push_back(measure("parse_args (800 options, no arguments)", large, none, 30));
+
+  // process_opt() and check_type() for a single value, on top of the empty parse
+  vector<string> one(1, "--int=8");
+  Result single = measure("process_opt + check_type (--int=8)", parser, one, 0);
+  single.allocations -= min(single.allocations, results[1].allocations);
+  single.bytes -= min(single.bytes, results[1].bytes);
+  single.budget = 8;
+  results.push_back(single);
+
+  parser.format_help();
+  allocations = bytes = 0;
+  counting = true;
+  parser.format_help();
+  counting = false;
+  Result help = { "format_help", allocations, bytes, 250 };
+  results.push_back(help);
+
+  int status = 0;
+  printf("%-38s %8s %8s %8s\n", "operation", "allocs", "bytes", "budget");
+  for (vector<Result>::const_iterator it = results.begin(); it != results.end(); ++it) {
+    bool over = it->allocations > it->budget;
+    printf("%-38s %8lu %8lu %8lu%s\n", it->name, static_cast<unsigned long>(it->allocations),
+        static_cast<unsigned long>(it->bytes), static_cast<unsigned long>(it->budget), over ? "  OVER BUDGET" : "");
+    if (over)
+      status = 1;
+  }
+  return status;
+}
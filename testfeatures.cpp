@@ -0,0 +1,1091 @@
+/**
+ * Behavioral checks of the features that go beyond Python's optparse (and
+ * so are not covered by test.sh).
+ *
+ * Every failed check is printed with its line, the exit status is 1 if
+ * there was any.
+ */
+
+#include "OptionParser.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#if __cplusplus >= 201103L
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#endif
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+using namespace optparse;
+
+static int failures = 0;
+
+#define CHECK(cond) check((cond), #cond, __LINE__)
+#define CHECK_EQ(a, b) check_eq((a), (b), #a, __LINE__)
+
+static void check(bool ok, const char* what, int line) {
+  if (not ok) {
+    fprintf(stderr, "testfeatures.cpp:%d: check failed: %s\n", line, what);
+    failures++;
+  }
+}
+static void check_eq(const string& a, const string& b, const char* what, int line) {
+  if (a != b) {
+    fprintf(stderr, "testfeatures.cpp:%d: check failed: %s is \"%s\", expected \"%s\"\n", line, what, a.c_str(), b.c_str());
+    failures++;
+  }
+}
+
+//! Up to eight arguments, null ones are left out
+static vector<string> args(const char* a0 = 0, const char* a1 = 0, const char* a2 = 0, const char* a3 = 0,
+    const char* a4 = 0, const char* a5 = 0, const char* a6 = 0, const char* a7 = 0) {
+  const char* const all[] = { a0, a1, a2, a3, a4, a5, a6, a7 };
+  vector<string> v;
+  for (size_t i = 0; i < 8 and all[i]; ++i)
+    v.push_back(all[i]);
+  return v;
+}
+
+//! The error message of a failing parse, without the "prog: error: " prefix
+static string parse_error(OptionParser& parser, const vector<string>& v) {
+  stringstream err;
+  streambuf* old = cerr.rdbuf(err.rdbuf());
+  string msg;
+  try {
+    parser.parse_args(v);
+  }
+  catch (int) {
+    msg = err.str();
+    if (msg == "")
+      msg = "(no message)";
+  }
+  cerr.rdbuf(old);
+  size_t pos = msg.find(": error: ");
+  if (pos != string::npos)
+    msg = msg.substr(pos + 9);
+  if (msg != "" and msg[msg.size() - 1] == '\n')
+    msg.erase(msg.size() - 1);
+  return msg;
+}
+
+//! Write a temporary file, return its name
+static string write_file(const char* name, const char* text) {
+  const string path = string("testfeatures-") + name + ".tmp";
+  ofstream out(path.c_str());
+  out << text;
+  return path;
+}
+
+static void test_packed_values() {
+  OptionParser parser;
+  parser.prog("testfeatures").add_help_option(false);
+  parser.add_option("-n", "--name");
+  parser.add_option("-v", "--verbose") .action("store_true");
+  parser.add_option("-m", "--more") .action("append");
+  parser.add_option("--level") .type("int") .set_default(3);
+  parser.add_option("--empty") .set_default("");
+  const Values& values = parser.parse_args(args("-n", "foo bar", "-m", "a", "-m", "", "-v"));
+
+  const string blob = values.pack();
+  PackedValues packed(blob.data(), blob.size());
+  CHECK(packed.valid());
+  CHECK_EQ(packed["name"], "foo bar");
+  CHECK_EQ(packed["verbose"], "1");
+  CHECK_EQ(packed["level"], "3");
+  CHECK(packed.is_set("level"));
+  CHECK(not packed.is_set_by_user("level"));
+  CHECK(packed.is_set_by_user("name"));
+  CHECK(not packed.is_set("empty"));
+  CHECK(not packed.is_set("missing"));
+  CHECK_EQ(packed["missing"], "");
+  CHECK_EQ(static_cast<const char*>(packed.get("level")), "3");
+  CHECK(packed.count("more") == 2);
+  CHECK_EQ(packed.all("more", 0), "a");
+  CHECK_EQ(packed.all("more", 1), "");
+  CHECK_EQ(packed.all("more", 2), "");
+  CHECK(packed.count("name") == 0);
+
+  // damaged blobs are rejected as a whole
+  CHECK(not PackedValues(blob.data(), blob.size() - 1).valid());
+  CHECK(not PackedValues(blob.data(), 8).valid());
+  string bad = blob;
+  bad[0] = 'X';
+  CHECK(not PackedValues(bad.data(), bad.size()).valid());
+  bad = blob;
+  bad[4]++;
+  CHECK(not PackedValues(bad.data(), bad.size()).valid());
+  CHECK(not PackedValues().valid());
+  CHECK_EQ(PackedValues()["name"], "");
+
+  // the blob does not depend on the parse it came from
+  Values empty;
+  const string empty_blob = empty.pack();
+  PackedValues packed_empty(empty_blob.data(), empty_blob.size());
+  CHECK(packed_empty.valid());
+  CHECK(not packed_empty.is_set("name"));
+}
+
+static void build_schema(OptionParser& parser) {
+  parser.prog("testfeatures").usage("%prog [options] FILE").version("%prog 2.0")
+    .description("Schema test.").epilog("The end.");
+  parser.set_defaults("verbosity", "50");
+  parser.add_option("-q", "--quiet", "--silent") .action("store_const") .set_const("0") .dest("verbosity")
+    .help("be quiet");
+  parser.add_option("-k") .action("count");
+  parser.add_option("-i", "--int") .type("int") .set_default(3) .metavar("N") .help("default: %default");
+  char const* const choices[] = { "foo", "bar", "baz" };
+  parser.add_option("-C", "--choices") .choices(&choices[0], &choices[3]);
+  parser.add_option("-m", "--more") .action("append");
+  parser.add_option("--point") .nargs(2);
+  parser.add_option("--hidden") .help(SUPPRESS_HELP);
+}
+
+// little-endian u32 of a schema blob, see the layout in OptionParser.cpp
+static unsigned int blob_u32(const string& blob, size_t pos) {
+  unsigned int v = 0;
+  for (int i = 3; i >= 0; --i)
+    v = (v << 8) | static_cast<unsigned char>(blob[pos + i]);
+  return v;
+}
+static void set_blob_u32(string& blob, size_t pos, unsigned int v) {
+  for (int i = 0; i < 4; ++i)
+    blob[pos + i] = static_cast<char>((v >> (8*i)) & 0xff);
+}
+//! Recompute the checksum of a modified schema blob
+static void reseal_schema(string& blob) {
+  unsigned int h = 2166136261u;
+  size_t i = 16;
+  for (; blob.size() - i >= 4; i += 4)
+    h = ((h ^ blob_u32(blob, i)) * 16777619u) & 0xffffffffu;
+  for (; i < blob.size(); ++i)
+    h = ((h ^ static_cast<unsigned char>(blob[i])) * 16777619u) & 0xffffffffu;
+  set_blob_u32(blob, 12, h);
+}
+
+static void test_schema() {
+  OptionParser a;
+  build_schema(a);
+  OptionGroup group(a, "Size Options", "Image Size Options.");
+  group.add_option("-w", "--width") .type("int") .set_default(640) .help("default: %default");
+  group.add_option("--height") .type("int");
+  a.add_option_group(group);
+
+  const string blob = a.dump_schema();
+  OptionParser b;
+  CHECK(b.load_schema(blob.data(), blob.size()));
+  CHECK_EQ(b.format_help(), a.format_help());
+  CHECK_EQ(b.get_usage(), a.get_usage());
+  CHECK_EQ(b.dump_schema(), blob);
+
+  const vector<string> good[] = {
+    args(),
+    args("-kk", "--sil", "-i", "7", "file"),
+    args("-Cbar", "-m", "x", "--more=y", "--point", "1", "2"),
+    args("--width=1", "--hei", "2", "--", "-k"),
+  };
+  for (size_t i = 0; i < sizeof(good) / sizeof(good[0]); ++i) {
+    const string pa = a.parse_args(good[i]).pack();
+    CHECK_EQ(b.parse_args(good[i]).pack(), pa);
+    CHECK(b.args() == a.args());
+  }
+  const vector<string> bad[] = {
+    args("--int=x"), args("-C", "qux"), args("--nope"), args("-w"), args("-k=1"),
+  };
+  for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); ++i) {
+    const string ea = parse_error(a, bad[i]);
+    CHECK(ea != "");
+    CHECK_EQ(parse_error(b, bad[i]), ea);
+  }
+
+  // damaged blobs are rejected before anything is added
+  for (size_t i = 0; i < 16; ++i) {
+    string bad_blob = blob;
+    bad_blob[i]++;
+    OptionParser c;
+    CHECK(not c.load_schema(bad_blob.data(), bad_blob.size()));
+  }
+  string bad_blob = blob;
+  bad_blob[blob.size() / 2]++;
+  OptionParser c;
+  CHECK(not c.load_schema(bad_blob.data(), bad_blob.size()));
+  CHECK(not c.load_schema(blob.data(), blob.size() - 1));
+
+  // list counts of a record beyond the blob, with a valid checksum
+  string resealed = blob;
+  reseal_schema(resealed);
+  CHECK(resealed == blob);
+  // settings field 9: the containers, container field 3: its options
+  const size_t records = blob_u32(blob, blob_u32(blob, 16 + 4*9) + 4*3);
+  for (size_t field = 0; field < 3; ++field) {
+    // short, long and choice count of the first record
+    const size_t count = records + 4 * (field == 0 ? 0 : field == 1 ? 2 : 10);
+    const unsigned int huge[] = { 0x7fffffffu, static_cast<unsigned int>(blob.size() / 4) };
+    for (size_t h = 0; h < 2; ++h) {
+      string corrupt = blob;
+      set_blob_u32(corrupt, count, huge[h]);
+      reseal_schema(corrupt);
+      OptionParser d;
+      CHECK(not d.load_schema(corrupt.data(), corrupt.size()));
+    }
+  }
+  CHECK(c.load_schema(blob.data(), blob.size()));
+}
+
+#if __cplusplus >= 201103L
+constexpr StaticOption static_options[] = {
+  { 'v', "verbose", "store_true", 0, 0, 0, "be verbose" },
+  { 'o', "output", 0, 0, 0, "a.out", "write to FILE", "FILE" },
+  { 0, "level", 0, "int", 0, "2" },
+};
+constexpr auto static_schema = make_static_schema(static_options);
+
+class SlowCheck : public AsyncCallback {
+public:
+  SlowCheck() : calls(0) {}
+  // values are "<milliseconds>" or "<milliseconds>!" (fails)
+  void operator() (const Option&, const string&, const string& val, const OptionParser&) {
+    this_thread::sleep_for(chrono::milliseconds(atoi(val.c_str())));
+    calls++;
+    if (val[val.size() - 1] == '!')
+      throw runtime_error("failed after " + val);
+  }
+  atomic<int> calls;
+};
+
+class Abort : public Callback {
+public:
+  void operator() (const Option&, const string&, const string&, const OptionParser&) {
+    throw logic_error("aborted");
+  }
+};
+
+static void test_async_callbacks() {
+  SlowCheck slow;
+  OptionParser parser;
+  parser.prog("testfeatures");
+  parser.add_option("-c", "--check") .action("callback") .type("string") .callback(slow);
+  parser.parse_args(args("-c", "20", "-c", "1", "--check=5"));
+  CHECK(slow.calls == 3);
+
+  // the first failure in argument order, not in time
+  CHECK_EQ(parse_error(parser, args("-c", "1", "-c", "60!", "-c", "1!")), "option -c: failed after 60!");
+  // and before the error of a later argument
+  parser.add_option("-i", "--int") .type("int");
+  CHECK_EQ(parse_error(parser, args("-c", "30!", "--nope")), "option -c: failed after 30!");
+  CHECK_EQ(parse_error(parser, args("-c", "5!", "--int=x")), "option -c: failed after 5!");
+  CHECK_EQ(parse_error(parser, args("-c", "5", "--int=x")), "option --int: invalid integer value: 'x'");
+  CHECK_EQ(parse_error(parser, args("--int=x", "-c", "1!")), "option --int: invalid integer value: 'x'");
+
+  // a failure of an aborted parse is not reported by the next one
+  Abort abort;
+  parser.add_option("--abort") .action("callback") .callback(abort);
+  bool aborted = false;
+  try {
+    parser.parse_args(args("-c", "30!", "--abort"));
+  }
+  catch (const logic_error&) {
+    aborted = true;
+  }
+  CHECK(aborted);
+  CHECK_EQ(parse_error(parser, args("-c", "1")), "");
+}
+
+static void test_layered_values() {
+  OptionParser parser;
+  parser.prog("testfeatures");
+  parser.add_option("-i", "--int") .type("int") .set_default(3);
+  parser.add_option("--cache") .type("size") .set_default("1K");
+  parser.add_option("-m", "--more") .action("append");
+
+  Values config;
+  config["int"] = "8";
+  LayeredValues layered;
+  layered.push(config);
+  // defaults of a parse result do not hide lower layers
+  layered.push(parser.parse_args(args("-m", "a", "-m", "b")));
+  CHECK_EQ(layered["int"], "8");
+  CHECK(not layered.is_set_by_user("int"));
+  CHECK_EQ(layered["cache"], "1K");
+  CHECK(layered.number("cache") == 1024);
+  CHECK(layered.all("more").size() == 2);
+  CHECK(layered.is_set_by_user("more"));
+  Values flat = layered.flatten();
+  CHECK_EQ(flat["int"], "8");
+  CHECK_EQ(flat["cache"], "1K");
+  CHECK(flat.number("cache") == 1024);
+  CHECK(flat.all("more").size() == 2);
+
+  layered.push(parser.parse_args(args("--int=5")));
+  CHECK_EQ(layered["int"], "5");
+  CHECK(layered.is_set_by_user("int"));
+  CHECK(layered.all("more").size() == 2);
+  layered.pop();
+  layered.pop();
+  layered.pop();
+  layered.push(parser.parse_args(args()));
+  CHECK_EQ(layered["int"], "3");
+
+  // every accessor uses the layer of operator[]
+  layered.top()["cache"] = "2K";
+  CHECK_EQ(layered["cache"], "2K");
+  CHECK(layered.number("cache") == 0);
+  layered.top().number("cache", 2048);
+  CHECK(layered.number("cache") == 2048);
+  layered.top()["more"] = "c";
+  CHECK_EQ(layered["more"], "c");
+  CHECK(layered.all("more").empty());
+  CHECK(layered.flatten().number("cache") == 2048);
+}
+
+class RecordChange : public ChangeListener {
+public:
+  void operator() (const string& dest, const Values& old_values, const Values& new_values) {
+    changes.push_back(dest + ": " + old_values[dest] + " -> " + new_values[dest]);
+  }
+  vector<string> changes;
+};
+
+static void test_reloadable_values() {
+  OptionParser parser;
+  parser.prog("testfeatures");
+  parser.add_option("-i", "--int") .type("int") .set_default(3);
+  parser.add_option("-n", "--name");
+  parser.add_option("-m", "--more") .action("append");
+  RecordChange change;
+  ReloadableValues config(parser);
+  config.on_change("int", change).on_change("more", change);
+  CHECK(not config.get().is_set("int"));
+
+  const Values& first = config.reload(args("-n", "a"));
+  CHECK(&config.get() == &first);
+  CHECK_EQ(config.get()["int"], "3");
+  CHECK(change.changes.size() == 1 and change.changes[0] == "int:  -> 3");
+
+  // replaced snapshots stay valid until collect(), listeners see changes only
+  config.reload(args("-n", "b"));
+  CHECK_EQ(first["name"], "a");
+  CHECK_EQ(config.get()["name"], "b");
+  CHECK(change.changes.size() == 1);
+  config.reload(args("-n", "b", "-i", "4", "-m", "x"));
+  CHECK(change.changes.size() == 3 and change.changes[1] == "int: 3 -> 4" and change.changes[2] == "more:  -> x");
+  config.collect();
+  CHECK_EQ(config.get()["int"], "4");
+
+  // a failed reload reports the error and keeps the current snapshot
+  const Values* current = &config.get();
+  stringstream err;
+  streambuf* old = cerr.rdbuf(err.rdbuf());
+  int status = 0;
+  try {
+    config.reload(args("--int=x"));
+  }
+  catch (int s) {
+    status = s;
+  }
+  cerr.rdbuf(old);
+  CHECK(status == 2);
+  CHECK(err.str().find("error: option --int: invalid integer value: 'x'") != string::npos);
+  CHECK(&config.get() == current);
+  CHECK_EQ(config.get()["int"], "4");
+  CHECK(change.changes.size() == 3);
+
+  // readers always see a complete snapshot
+  config.reload(args("-i", "0", "-n", "0"));
+  atomic<bool> done(false);
+  atomic<int> torn(0);
+  thread reader([&] {
+    while (not done) {
+      const Values& v = config.get();
+      if (v["int"] != v["name"])
+        torn++;
+    }
+  });
+  for (int i = 0; i < 200; ++i) {
+    const string n = to_string(i);
+    config.reload(args("-i", n.c_str(), "-n", n.c_str()));
+  }
+  done = true;
+  reader.join();
+  config.collect();
+  CHECK(torn == 0);
+  CHECK_EQ(config.get()["int"], "199");
+}
+
+#if __cplusplus >= 201402L
+// 600 options o100 ... o699, more than the constexpr depth limit of 512
+#define OPT(n) { 0, "o" #n }
+#define OPT10(n) OPT(n##0), OPT(n##1), OPT(n##2), OPT(n##3), OPT(n##4), \
+  OPT(n##5), OPT(n##6), OPT(n##7), OPT(n##8), OPT(n##9)
+#define OPT100(n) OPT10(n##0), OPT10(n##1), OPT10(n##2), OPT10(n##3), OPT10(n##4), \
+  OPT10(n##5), OPT10(n##6), OPT10(n##7), OPT10(n##8), OPT10(n##9)
+constexpr StaticOption large_options[] = {
+  OPT100(1), OPT100(2), OPT100(3), OPT100(4), OPT100(5), OPT100(6),
+};
+constexpr auto large_schema = make_static_schema(large_options);
+#endif
+
+static void test_static_schema() {
+  OptionParser parser;
+  parser.prog("testfeatures");
+  parser.add_static_options(static_schema);
+  const Values& values = parser.parse_args(args("-vo", "x", "--lev=5", "--out", "y"));
+  CHECK_EQ(values["verbose"], "1");
+  CHECK_EQ(values["output"], "y");
+  CHECK_EQ(values["level"], "5");
+  CHECK_EQ(parser.parse_args(args())["output"], "a.out");
+  CHECK_EQ(parse_error(parser, args("--le=x")), "option --le: invalid integer value: 'x'");
+  CHECK_EQ(parse_error(parser, args("--nope")), "no such option: --nope");
+  CHECK_EQ(parse_error(parser, args("-x")), "no such option: -x");
+
+#if __cplusplus >= 201402L
+  OptionParser large;
+  large.prog("testfeatures");
+  large.add_static_options(large_schema);
+  const Values& v = large.parse_args(args("--o537=x", "--o699", "y", "--o100", "z", "--o698", "w"));
+  CHECK_EQ(v["o537"], "x");
+  CHECK_EQ(v["o699"], "y");
+  CHECK_EQ(v["o100"], "z");
+  CHECK_EQ(v["o698"], "w");
+  CHECK(parse_error(large, args("--o12=1")).find("ambiguous option: --o12 (--o120, --o121,") == 0);
+  CHECK_EQ(parse_error(large, args("--o7=1")), "no such option: --o7");
+#endif
+
+  // evaluated at run time, duplicates throw instead of failing to compile
+  const StaticOption dup_short[] = { { 'a', "alpha" }, { 'a', "beta" } };
+  const StaticOption dup_long[] = { { 'a', "alpha" }, { 'b', "alpha" } };
+  string err;
+  try { StaticSchema<2> schema(dup_short); } catch (const char* e) { err = e; }
+  CHECK_EQ(err, "duplicate short option");
+  err = "";
+  try { StaticSchema<2> schema(dup_long); } catch (const char* e) { err = e; }
+  CHECK_EQ(err, "duplicate long option");
+}
+
+static void test_static_schema_dump() {
+  OptionParser a;
+  a.prog("testfeatures");
+  a.add_static_options(static_schema);
+  a.add_option("--extra");
+  const string blob = a.dump_schema();
+  OptionParser b;
+  CHECK(b.load_schema(blob.data(), blob.size()));
+  CHECK_EQ(b.format_help(), a.format_help());
+  const vector<string> v = args("-vo", "x", "--lev=5", "--ex", "y");
+  const string pa = a.parse_args(v).pack();
+  CHECK_EQ(b.parse_args(v).pack(), pa);
+}
+#endif
+
+static void build_env(OptionParser& parser) {
+  parser.prog("testfeatures").env_prefix("TF_");
+  parser.set_defaults("verbosity", "50");
+  parser.add_option("--verbose") .action("store_const") .set_const("100") .dest("verbosity");
+  parser.add_option("-s", "--silent") .action("store_const") .set_const("0") .dest("verbosity");
+  parser.add_option("--no-clear") .action("store_true");
+  parser.add_option("--clear") .action("store_false") .dest("no_clear") .env("TF_CLEAR");
+  parser.add_option("-k") .action("count");
+  parser.add_option("-i", "--int") .type("int") .set_default(3);
+  parser.add_option("--cache") .type("size");
+  parser.add_option("--milk") .action("append_const") .set_const("milk") .env("TF_MILK");
+}
+
+static void test_env() {
+  const char* const vars[] = { "TF_VERBOSITY", "TF_NO_CLEAR", "TF_CLEAR", "TF_K", "TF_INT", "TF_CACHE", "TF_MILK" };
+  for (size_t i = 0; i < sizeof(vars) / sizeof(vars[0]); ++i)
+    unsetenv(vars[i]);
+
+  OptionParser parser;
+  build_env(parser);
+  const string blob = parser.dump_schema();
+  OptionParser loaded;
+  CHECK(loaded.load_schema(blob.data(), blob.size()));
+  CHECK_EQ(loaded.env_prefix(), "TF_");
+
+  for (int pass = 0; pass < 2; ++pass) {
+    OptionParser& p = pass ? loaded : parser;
+    // dests of const actions only are not bound
+    setenv("TF_VERBOSITY", "7", 1);
+    CHECK_EQ(p.parse_args(args())["verbosity"], "50");
+    // flags sharing a dest are set by the value of the dest
+    setenv("TF_NO_CLEAR", "1", 1);
+    CHECK_EQ(p.parse_args(args())["no_clear"], "1");
+    setenv("TF_NO_CLEAR", "", 1);
+    CHECK_EQ(p.parse_args(args())["no_clear"], "0");
+    unsetenv("TF_NO_CLEAR");
+    // an explicit variable acts like its option
+    setenv("TF_CLEAR", "yes", 1);
+    CHECK_EQ(p.parse_args(args())["no_clear"], "0");
+    setenv("TF_CLEAR", "off", 1);
+    CHECK_EQ(p.parse_args(args())["no_clear"], "1");
+    unsetenv("TF_CLEAR");
+    setenv("TF_K", "5", 1);
+    CHECK_EQ(p.parse_args(args())["k"], "5");
+    CHECK_EQ(p.parse_args(args("-k"))["k"], "1");
+    setenv("TF_K", "x", 1);
+    CHECK_EQ(parse_error(p, args()), "option TF_K: invalid integer value: 'x'");
+    unsetenv("TF_K");
+    setenv("TF_INT", "9", 1);
+    CHECK_EQ(p.parse_args(args())["int"], "9");
+    CHECK(p.parse_args(args()).is_set_by_user("int"));
+    CHECK_EQ(p.parse_args(args("--int=2"))["int"], "2");
+    setenv("TF_INT", "x", 1);
+    CHECK_EQ(parse_error(p, args()), "option TF_INT: invalid integer value: 'x'");
+    unsetenv("TF_INT");
+    setenv("TF_CACHE", "2K", 1);
+    CHECK(p.parse_args(args()).number("cache") == 2048);
+    unsetenv("TF_CACHE");
+    setenv("TF_MILK", "1", 1);
+    CHECK(p.parse_args(args()).all("milk").size() == 1);
+    setenv("TF_MILK", "0", 1);
+    CHECK(p.parse_args(args()).all("milk").empty());
+    unsetenv("TF_MILK");
+    unsetenv("TF_VERBOSITY");
+  }
+
+  // the bindings follow options added and prefixes changed after a parse
+  setenv("TF_LATE", "1", 1);
+  setenv("OTHER_INT", "4", 1);
+  parser.add_option("--late");
+  CHECK_EQ(parser.parse_args(args())["late"], "1");
+  parser.env_prefix("OTHER_");
+  CHECK_EQ(parser.parse_args(args())["int"], "4");
+  CHECK(not parser.parse_args(args()).is_set("late"));
+  unsetenv("TF_LATE");
+  unsetenv("OTHER_INT");
+}
+
+static void test_suggestions() {
+  OptionParser parser;
+  parser.prog("testfeatures").suggest_on_error(true);
+  parser.add_option("--verbose") .action("store_true");
+  char const* const choices[] = { "foo", "bar", "baz" };
+  parser.add_option("-C", "--choices") .choices(&choices[0], &choices[3]);
+  CHECK_EQ(parse_error(parser, args("--verbse")), "no such option: --verbse, maybe you meant --verbose?");
+  CHECK_EQ(parse_error(parser, args("--colour")), "no such option: --colour");
+  CHECK_EQ(parse_error(parser, args("-C", "bax")),
+      "option -C: invalid choice: 'bax', maybe you meant 'bar'? (choose from 'foo', 'bar', 'baz')");
+
+  // options added after a failed parse are suggested too
+  parser.add_option("--color");
+  CHECK_EQ(parse_error(parser, args("--colour")), "no such option: --colour, maybe you meant --color?");
+  OptionGroup group(parser, "Group");
+  group.add_option("--height") .type("int");
+  parser.add_option_group(group);
+  CHECK_EQ(parse_error(parser, args("--hieght=1")), "no such option: --hieght, maybe you meant --height?");
+
+  parser.suggest_on_error(false);
+  CHECK_EQ(parse_error(parser, args("--verbse")), "no such option: --verbse");
+}
+
+//! Number of a unit option after parsing val, -1 if val is invalid
+static double unit_value(const char* type, const char* val) {
+  OptionParser parser;
+  parser.prog("testfeatures");
+  parser.add_option("--x") .type(type);
+  if (parse_error(parser, args("--x", val)) != "")
+    return -1;
+  return parser.parse_args(args("--x", val)).number("x");
+}
+
+static void test_shared_group() {
+  OptionGroup group("Shared", "Options of both parsers.");
+  group.add_option("-v", "--verbose") .action("store_true");
+  group.add_option("--level") .type("int") .set_default(1);
+  group.add_option("--cache") .type("size") .set_default("1K");
+  char const* const colors[] = { "red", "green" };
+  group.add_option("--color") .choices(&colors[0], &colors[2]);
+
+  OptionParser p1;
+  p1.prog("testfeatures").suggest_on_error(true);
+  p1.add_option("-n", "--name");
+  p1.add_option_group(group);
+  OptionParser p2;
+  p2.prog("testfeatures");
+  p2.add_option("--verbosity") .type("int");
+  p2.add_option_group(group);
+  // defaults set with set_defaults() come from the parser doing the parse
+  p2.set_defaults("level", "7");
+
+  const Values& v1 = p1.parse_args(args("-vn", "x", "--lev=2", "--cache=2K"));
+  CHECK_EQ(v1["verbose"], "1");
+  CHECK_EQ(v1["name"], "x");
+  CHECK_EQ(v1["level"], "2");
+  CHECK(v1.number("cache") == 2048);
+  CHECK_EQ(p1.parse_args(args())["level"], "1");
+  CHECK_EQ(p2.parse_args(args())["level"], "7");
+  CHECK(p2.parse_args(args()).number("cache") == 1024);
+
+  // abbreviations are resolved over the options of the parser and the group
+  CHECK_EQ(parse_error(p2, args("--verb")), "ambiguous option: --verb (--verbose, --verbosity?)");
+  CHECK_EQ(p2.parse_args(args("--verbose"))["verbose"], "1");
+  CHECK_EQ(p2.parse_args(args("--verbosi=3"))["verbosity"], "3");
+  CHECK_EQ(p1.parse_args(args("--verb"))["verbose"], "1");
+  CHECK_EQ(parse_error(p2, args("-n", "x")), "no such option: -n");
+  CHECK_EQ(parse_error(p1, args("--colr=red")), "no such option: --colr, maybe you meant --color?");
+  CHECK_EQ(parse_error(p1, args("--color=gren")),
+      "option --color: invalid choice: 'gren', maybe you meant 'green'? (choose from 'red', 'green')");
+  CHECK(p1.format_help().find("Shared:") != string::npos);
+  // the group is frozen once it is added
+  bool frozen = false;
+  try {
+    group.add_option("--late");
+  }
+  catch (const char*) {
+    frozen = true;
+  }
+  CHECK(frozen);
+  CHECK_EQ(parse_error(p1, args("--late")), "no such option: --late");
+  CHECK(p2.format_help().find("--level=LEVEL") != string::npos);
+
+#if __cplusplus >= 201103L
+  // the parser keeps a shared group alive
+  OptionParser p3;
+  p3.prog("testfeatures");
+  {
+    shared_ptr<OptionGroup> g = make_shared<OptionGroup>("Temporary");
+    g->add_option("--temp") .type("int");
+    p3.add_option_group(shared_ptr<const OptionGroup>(g));
+  }
+  CHECK_EQ(p3.parse_args(args("--te=4"))["temp"], "4");
+#endif
+}
+
+class CollectArgs : public ArgumentSink {
+public:
+  void operator() (const string& arg, const OptionParser&) { received.push_back(arg); }
+  vector<string> received;
+};
+
+static void test_args_sink() {
+  OptionParser parser;
+  parser.prog("testfeatures");
+  parser.add_option("-n", "--name");
+  parser.add_option("-v") .action("store_true");
+  parser.add_positional("ignored");
+  CollectArgs sink;
+  parser.args_sink(sink);
+
+  // in order, including the arguments after "--", none of them in args()
+  const Values& values = parser.parse_args(args("a", "-n", "x", "b", "--", "-v", "c"));
+  CHECK(sink.received.size() == 4);
+  CHECK(sink.received == args("a", "b", "-v", "c"));
+  CHECK(parser.args().empty());
+  CHECK_EQ(values["name"], "x");
+  CHECK(not values.is_set("v"));
+  CHECK(not values.is_set("ignored"));
+
+  // arguments already delivered stay delivered when the parse fails
+  sink.received.clear();
+  CHECK_EQ(parse_error(parser, args("a", "--nope", "b")), "no such option: --nope");
+  CHECK(sink.received == args("a"));
+
+  sink.received.clear();
+  parser.disable_interspersed_args();
+  parser.parse_args(args("-v", "a", "-n", "x"));
+  CHECK(sink.received == args("a", "-n", "x"));
+  CHECK(not parser.parse_args(args()).is_set("name"));
+}
+
+static void test_positionals() {
+  OptionParser parser;
+  parser.prog("testfeatures");
+  parser.add_option("-v") .action("store_true");
+  parser.add_positional("command");
+  parser.add_positional("sizes") .type("size") .nargs(0, 2);
+  parser.add_positional("files") .nargs(1, Positional::UNLIMITED);
+  parser.add_positional("target") .type("int");
+
+  // earlier positionals take as many of the surplus arguments as they can
+  const Values& values = parser.parse_args(args("run", "1K", "-v", "2K", "a", "b", "7"));
+  CHECK_EQ(values["command"], "run");
+  CHECK(values.all("command").empty());
+  CHECK_EQ(values["sizes"], "1K");
+  CHECK(values.all("sizes").size() == 2 and values.all("sizes").back() == "2K");
+  CHECK(values.number("sizes") == 1024);
+  CHECK(values.all_numbers("sizes").size() == 2 and values.all_numbers("sizes")[1] == 2048);
+  CHECK(values.all("files").size() == 2 and values.all("files").front() == "a");
+  CHECK_EQ(values["target"], "7");
+  CHECK(values.is_set_by_user("target"));
+  CHECK_EQ(values["v"], "1");
+
+  const Values& fewer = parser.parse_args(args("run", "a", "7"));
+  CHECK(fewer.all("sizes").empty() and not fewer.is_set("sizes"));
+  CHECK(fewer.all("files").size() == 1);
+  CHECK_EQ(parser.parse_args(args("run", "1K", "2K", "a", "b", "c", "7")).all("files").back(), "c");
+
+  CHECK_EQ(parse_error(parser, args()), "the following arguments are required: command, files, target");
+  CHECK_EQ(parse_error(parser, args("run", "a")), "the following arguments are required: target");
+  CHECK_EQ(parse_error(parser, args("run", "a", "x")), "argument target: invalid integer value: 'x'");
+  CHECK_EQ(parse_error(parser, args("run", "1Q", "a", "7")), "argument sizes: invalid size value: '1Q'");
+
+  // positionals are part of the schema
+  OptionParser loaded;
+  const string blob = parser.dump_schema();
+  CHECK(loaded.load_schema(blob.data(), blob.size()));
+  CHECK_EQ(loaded.dump_schema(), blob);
+  const vector<string> cases[] = {
+    args("run", "1K", "-v", "2K", "a", "b", "7"), args("run", "a", "7"), args(), args("run", "a", "x"),
+    args("run", "1Q", "a", "7"),
+  };
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+    const string err = parse_error(parser, cases[i]);
+    CHECK_EQ(parse_error(loaded, cases[i]), err);
+    if (err == "")
+      CHECK_EQ(loaded.parse_args(cases[i]).pack(), parser.parse_args(cases[i]).pack());
+  }
+
+  OptionParser bounded;
+  bounded.prog("testfeatures");
+  bounded.add_positional("pair") .nargs(2);
+  char const* const modes[] = { "fast", "slow" };
+  bounded.add_positional("mode") .choices(&modes[0], &modes[2]) .nargs(0, 1);
+  const string bounded_blob = bounded.dump_schema();
+  OptionParser bounded_loaded;
+  CHECK(bounded_loaded.load_schema(bounded_blob.data(), bounded_blob.size()));
+  CHECK_EQ(parse_error(bounded_loaded, args("a", "b", "fats")),
+      "argument mode: invalid choice: 'fats' (choose from 'fast', 'slow')");
+  CHECK_EQ(bounded_loaded.parse_args(args("a", "b", "slow"))["mode"], "slow");
+
+  // an arity that could not be filled is rejected when it is declared
+  bool rejected = false;
+  try {
+    OptionParser invalid;
+    invalid.add_positional("x") .nargs(3, 1);
+  }
+  catch (const char*) {
+    rejected = true;
+  }
+  CHECK(rejected);
+  CHECK_EQ(parse_error(bounded, args("a", "b", "c", "d")), "unrecognized arguments: d");
+  CHECK(bounded.parse_args(args("a", "b")).all("pair").size() == 2);
+
+  // validated by several threads, the first error in argument order is reported
+  OptionParser many;
+  many.prog("testfeatures");
+  many.add_positional("n") .type("int") .nargs(1, Positional::UNLIMITED);
+  vector<string> numbers;
+  for (int i = 0; i < 1000; ++i) {
+    ostringstream n;
+    n << i;
+    numbers.push_back(n.str());
+  }
+  const Values& all = many.parse_args(numbers);
+  CHECK(all.all("n").size() == 1000 and all.all("n").back() == "999");
+  numbers[700] = "x700";
+  numbers[300] = "x300";
+  CHECK_EQ(parse_error(many, numbers), "argument n: invalid integer value: 'x300'");
+
+  OptionParser files;
+  files.prog("testfeatures");
+  files.add_positional("dir") .type("directory");
+  files.add_positional("file") .type("existing_file") .nargs(0, 1);
+  const string file = write_file("positional", "");
+  CHECK_EQ(files.parse_args(args(".", file.c_str()))["file"], file);
+  CHECK_EQ(parse_error(files, args(file.c_str())), "argument dir: not a directory: '" + file + "'");
+  CHECK_EQ(parse_error(files, args(".", ".")), "argument file: is a directory: '.'");
+  remove(file.c_str());
+  CHECK_EQ(parse_error(files, args(".", file.c_str())), "argument file: no such file or directory: '" + file + "'");
+}
+
+static void test_units() {
+  CHECK(unit_value("size", "512") == 512);
+  CHECK(unit_value("size", "4K") == 4096);
+  CHECK(unit_value("size", "64MiB") == 64 * 1048576.0);
+  CHECK(unit_value("size", "1.5GB") == 1.5e9);
+  CHECK(unit_value("size", "0.5K") == 512);
+  CHECK(unit_value("size", "1.5B") == -1);
+  CHECK(unit_value("size", "K") == -1);
+  CHECK(unit_value("size", "4k") == -1);
+  CHECK(unit_value("size", "-1K") == -1);
+  CHECK(unit_value("size", "1e3") == -1);
+  CHECK(unit_value("duration", "30") == 30);
+  CHECK(unit_value("duration", "250ms") == 0.25);
+  CHECK(unit_value("duration", "1h30m") == 5400);
+  CHECK(unit_value("duration", "1h30") == -1);
+  CHECK(unit_value("duration", "") == -1);
+  CHECK(unit_value("duration", "h") == -1);
+  CHECK(unit_value("percent", "25%") == 0.25);
+  CHECK(unit_value("percent", "-5%") == -0.05);
+  CHECK(unit_value("percent", "0.5") == 0.5);
+  CHECK(unit_value("percent", "%") == -1);
+  CHECK(unit_value("percent", "5%%") == -1);
+
+  OptionParser parser;
+  parser.prog("testfeatures");
+  parser.add_option("-l", "--limit") .type("size") .action("append");
+  parser.add_option("--timeout") .type("duration") .set_default("1m");
+  parser.add_positional("delays") .type("duration") .nargs(1, Positional::UNLIMITED);
+  CHECK_EQ(parse_error(parser, args("--limit=1X", "1")), "option --limit: invalid size value: '1X'");
+  CHECK_EQ(parse_error(parser, args("1x")), "argument delays: invalid duration value: '1x'");
+
+  // every value of an append option or positional is kept
+  const Values& values = parser.parse_args(args("-l", "1K", "5", "--limit=2K", "1h", "10ms"));
+  CHECK(values.number("limit") == 2048);
+  CHECK(values.all_numbers("limit").size() == 2);
+  CHECK(values.all_numbers("limit")[0] == 1024 and values.all_numbers("limit")[1] == 2048);
+  CHECK(values.number("timeout") == 60);
+  CHECK(values.all_numbers("timeout").empty());
+  CHECK_EQ(values["delays"], "5");
+  CHECK(values.number("delays") == 5);
+  CHECK(values.all_numbers("delays").size() == 3 and values.all_numbers("delays")[2] == 0.01);
+
+  const string blob = values.pack();
+  PackedValues packed(blob.data(), blob.size());
+  CHECK(packed.valid());
+  CHECK(packed.number("limit") == 2048);
+  CHECK(packed.all_numbers("limit", 0) == 1024 and packed.all_numbers("limit", 1) == 2048);
+  CHECK(packed.all_numbers("limit", 2) == 0);
+  CHECK(packed.number("timeout") == 60);
+  CHECK(packed.all_numbers("delays", 1) == 3600);
+  CHECK(packed.number("missing") == 0);
+  CHECK(Values(values).all_numbers("delays") == values.all_numbers("delays"));
+}
+
+static void test_config_files() {
+  const string lower = write_file("lower",
+      "int = 8\n"
+      "more = x\n"
+      "verbose = 1\n"
+      "[app]\n"
+      "no_clear = 1\n");
+  const string upper = write_file("upper",
+      "# comment\n"
+      "int = 7\n"
+      "verbose = off\n"
+      "more = a\n"
+      "more: b\n");
+  const string bad = write_file("bad",
+      "[app]\n"
+      "k = 2\n"
+      "\n"
+      "int = x\n");
+  ConfigFile lower_file(lower), upper_file(upper), app_file(lower), bad_file(bad);
+
+  OptionParser parser;
+  parser.prog("testfeatures");
+  parser.set_defaults("verbosity", "50");
+  parser.add_option("--verbose") .action("store_true");
+  parser.add_option("-s", "--silent") .action("store_const") .set_const("0") .dest("verbosity");
+  parser.add_option("--no-clear") .action("store_true");
+  parser.add_option("--clear") .action("store_false") .dest("no_clear");
+  parser.add_option("-k") .action("count");
+  parser.add_option("-i", "--int") .type("int") .set_default(3);
+  parser.add_option("-m", "--more") .action("append");
+  parser.add_config_file(lower_file).add_config_file(upper_file);
+
+  // later files first, all entries of one file are applied
+  const Values& values = parser.parse_args(args());
+  CHECK_EQ(values["int"], "7");
+  CHECK(values.is_set_by_user("int"));
+  CHECK_EQ(values["verbose"], "0");
+  CHECK(values.all("more").size() == 2 and values.all("more").back() == "b");
+  CHECK_EQ(parser.parse_args(args("--int=5"))["int"], "5");
+  CHECK(parser.parse_args(args("-m", "c")).all("more").size() == 1);
+
+  OptionParser p2;
+  p2.prog("testfeatures");
+  p2.add_option("--verbose") .action("store_true");
+  p2.add_option("--no-clear") .action("store_true");
+  p2.add_option("--clear") .action("store_false") .dest("no_clear");
+  p2.add_option("-k") .action("count");
+  p2.add_option("-i", "--int") .type("int");
+  p2.add_option("-s", "--silent") .action("store_const") .set_const("0") .dest("verbosity");
+  p2.add_config_file(app_file, "app");
+  // a dest shared by flags is set by its value
+  CHECK_EQ(p2.parse_args(args())["no_clear"], "1");
+
+  // an empty value switches a flag off, like in the environment
+  const string empty = write_file("empty", "verbose =\nclear =\nsilent =\n");
+  ConfigFile empty_file(empty);
+  OptionParser p3;
+  p3.prog("testfeatures");
+  p3.set_defaults("verbosity", "50");
+  p3.add_option("--verbose") .action("store_true") .set_default("1");
+  p3.add_option("--clear") .action("store_false") .dest("no_clear");
+  p3.add_option("-s", "--silent") .action("store_const") .set_const("0") .dest("verbosity");
+  p3.add_config_file(empty_file);
+  const Values& v3 = p3.parse_args(args());
+  CHECK_EQ(v3["verbose"], "0");
+  CHECK_EQ(v3["no_clear"], "1");
+  CHECK_EQ(v3["verbosity"], "50");
+
+  // errors name the file and line once
+  OptionParser p4;
+  p4.prog("testfeatures");
+  p4.add_option("-k") .action("count");
+  p4.add_option("-i", "--int") .type("int");
+  p4.add_option("-s", "--silent") .action("store_const") .set_const("0") .dest("verbosity");
+  p4.add_config_file(bad_file, "app");
+  CHECK_EQ(parse_error(p4, args()), bad + ":4: option --int: invalid integer value: 'x'");
+  const string unknown = write_file("unknown", "k = 1\nnope = 1\n");
+  const string syntax = write_file("syntax", "k = 1\nk\n");
+  const string count = write_file("count", "\n\nk = two\n");
+  const string consts = write_file("consts", "verbosity = 50\n");
+  const string* const files[] = { &unknown, &syntax, &count, &consts };
+  const char* const errors[] = {
+    ":2: no such option: nope", ":2: syntax error", ":3: option k: invalid integer value: 'two'",
+    ":1: no such option: verbosity",
+  };
+  for (size_t i = 0; i < 4; ++i) {
+    ConfigFile f(*files[i]);
+    OptionParser p;
+    p.prog("testfeatures");
+    p.add_option("-k") .action("count");
+    p.add_option("-s", "--silent") .action("store_const") .set_const("0") .dest("verbosity");
+    p.add_config_file(f);
+    CHECK_EQ(parse_error(p, args()), *files[i] + errors[i]);
+  }
+  ConfigFile count_file(count);
+  CHECK(count_file.section("").front().line == 3);
+
+  const string* const all[] = { &lower, &upper, &bad, &empty, &unknown, &syntax, &count, &consts };
+  for (size_t i = 0; i < sizeof(all) / sizeof(all[0]); ++i)
+    remove(all[i]->c_str());
+}
+
+static void test_arena() {
+  OptionParser parser;
+  parser.prog("testfeatures");
+  parser.add_option("-n", "--name");
+  parser.add_option("-m", "--more") .action("append");
+  parser.add_option("--size") .type("size");
+
+  // small blocks, so that the results span several of them
+  Arena arena(256);
+  parser.arena(&arena);
+  const Values& values = parser.parse_args(args("-n", "a rather long name, longer than any short string",
+      "-m", "x", "-m", "y", "--size=2K", "rest"));
+  CHECK_EQ(values["name"], "a rather long name, longer than any short string");
+  CHECK(values.all("more").size() == 2);
+  CHECK(arena.allocated() > 0);
+  const Values copy = values;
+  Values own(arena);
+  own["name"] = "own";
+
+  // releasing empties the values allocated from the arena, not their copies
+  arena.release();
+  CHECK(arena.allocated() == 0);
+  CHECK(not values.is_set("name"));
+  CHECK(values.all("more").empty());
+  CHECK(not own.is_set("name"));
+  own["name"] = "again";
+  CHECK_EQ(own["name"], "again");
+  CHECK_EQ(copy["name"], "a rather long name, longer than any short string");
+  CHECK(copy.all("more").size() == 2 and copy.number("size") == 2048);
+
+  // the next parse allocates from the released arena
+  const Values& next = parser.parse_args(args("-n", "b", "-m", "z", "other"));
+  CHECK_EQ(next["name"], "b");
+  CHECK(next.all("more").size() == 1 and next.all("more").front() == "z");
+  CHECK(parser.args().size() == 1 and parser.args().front() == "other");
+  CHECK(arena.allocated() > 0);
+  arena.release();
+  CHECK_EQ(parser.parse_args(args("-n", "c"))["name"], "c");
+}
+
+#if __cplusplus >= 201103L
+static void test_parse_cache() {
+  OptionParser parser;
+  parser.prog("testfeatures");
+  parser.add_option("-n", "--name");
+  parser.add_option("-m", "--more") .action("append");
+  ParseCache cache(parser, 2);
+
+  shared_ptr<const ParseResult> a = cache.parse_args(args("-n", "a", "x"));
+  CHECK(cache.hits() == 0 and cache.misses() == 1 and cache.size() == 1);
+  CHECK_EQ(a->values["name"], "a");
+  CHECK(a->args.size() == 1 and a->args[0] == "x");
+  CHECK(cache.parse_args(args("-n", "a", "x")) == a);
+  CHECK(cache.hits() == 1);
+  // the arguments are compared one by one, not concatenated
+  CHECK(cache.parse_args(args("-n", "ax")) != a);
+  CHECK(cache.misses() == 2 and cache.size() == 2);
+
+  // the least recently used entry is evicted
+  cache.parse_args(args("-n", "a", "x"));
+  cache.parse_args(args("-m", "1"));
+  CHECK(cache.size() == 2);
+  CHECK(cache.parse_args(args("-n", "a", "x")) == a);
+  const size_t misses = cache.misses();
+  cache.parse_args(args("-n", "ax"));
+  CHECK(cache.misses() == misses + 1);
+
+  // failed parses are not cached
+  stringstream err;
+  streambuf* old = cerr.rdbuf(err.rdbuf());
+  for (int i = 0; i < 2; ++i) {
+    try {
+      cache.parse_args(args("--nope"));
+    }
+    catch (int) {
+    }
+  }
+  cerr.rdbuf(old);
+  CHECK(cache.misses() == misses + 3 and cache.size() == 2);
+  cache.clear();
+  CHECK(cache.size() == 0);
+
+  // the result of a check of the file system may change between parses
+  const string file = write_file("cached", "");
+  OptionParser files;
+  files.prog("testfeatures");
+  files.add_option("-f", "--file") .type("existing_file");
+  files.add_option("-d") .type("directory");
+  files.add_option("-n", "--name");
+  ParseCache files_cache(files);
+  files_cache.parse_args(args("-f", file.c_str()));
+  files_cache.parse_args(args("-f", file.c_str()));
+  files_cache.parse_args(args("-d", "."));
+  CHECK(files_cache.hits() == 0 and files_cache.size() == 0);
+  files_cache.parse_args(args("-n", file.c_str()));
+  files_cache.parse_args(args("-n", file.c_str()));
+  CHECK(files_cache.hits() == 1 and files_cache.size() == 1);
+
+  OptionParser positional;
+  positional.prog("testfeatures");
+  positional.add_positional("input") .type("existing_file") .nargs(0, Positional::UNLIMITED);
+  ParseCache positional_cache(positional);
+  positional_cache.parse_args(args(file.c_str()));
+  positional_cache.parse_args(args(file.c_str()));
+  CHECK(positional_cache.hits() == 0 and positional_cache.size() == 0);
+  // without arguments, nothing was checked
+  positional_cache.parse_args(args());
+  positional_cache.parse_args(args());
+  CHECK(positional_cache.hits() == 1);
+  remove(file.c_str());
+}
+#endif
+
+int main()
+{
+  test_packed_values();
+  test_schema();
+  test_env();
+  test_suggestions();
+  test_shared_group();
+  test_args_sink();
+  test_positionals();
+  test_units();
+  test_config_files();
+  test_arena();
+#if __cplusplus >= 201103L
+  test_static_schema();
+  test_static_schema_dump();
+  test_async_callbacks();
+  test_layered_values();
+  test_reloadable_values();
+  test_parse_cache();
+#endif
+
+  if (failures)
+    fprintf(stderr, "%d check(s) failed\n", failures);
+  return failures ? 1 : 0;
+}
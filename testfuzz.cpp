@@ -0,0 +1,379 @@
+/**
+ * Fuzz harness for parse_args() and format_help() that watches latency.
+ *
+ * Every input is decoded into a schema (options, groups, help texts) and a
+ * command line. Built with libFuzzer (see "make fuzzer"), only
+ * LLVMFuzzerTestOneInput() is used. Otherwise main() is a standalone
+ * driver without any dependencies:
+ *
+ *   testfuzz FILE...                        run saved inputs, printing the time of each
+ *   testfuzz [-runs=N] [-seed=S] [-latency] run N generated inputs, then scaling checks
+ *
+ * The scaling checks time the slowest generated inputs with their command
+ * line repeated, and a few worst cases (clustered flags, long option
+ * lookups, help texts) at growing sizes. Cost that grows clearly faster
+ * than the input is reported; only with -latency (see "make fuzz-latency")
+ * it makes the exit status 1, as wall-clock ratios are noisy on loaded
+ * machines.
+ */
+
+#include "OptionParser.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <stdint.h>
+#include <algorithm>
+#include <fstream>
+#include <list>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+using namespace optparse;
+
+//! Reads the input uint8_t by uint8_t, zeros once it is exhausted
+class Input {
+  public:
+    Input(const uint8_t* data, size_t size) : _p(data), _end(data + size) {}
+    bool empty() const { return _p == _end; }
+    uint8_t next() { return empty() ? 0 : *_p++; }
+  private:
+    const uint8_t* _p;
+    const uint8_t* _end;
+};
+
+// small alphabets, so that names collide and share prefixes
+static const char short_names[] = "abcdefgxyzABC0-";
+static const char long_chars[] = "abcde-";
+static const char* const words[] = { "lorem", "ipsum", "%default", "dolor", " ", "\n", "sit", "%prog",
+  "consectetur-adipisicing-elit-sed-do-eiusmod-tempor" };
+static const char* const actions[] = { "store", "store_true", "store_false", "store_const",
+  "append", "append_const", "count" };
+static const char* const types[] = { "", "string", "int", "long", "float", "complex", "choice",
+  "size", "duration", "percent" };
+static const char* const values[] = { "", "0", "1", "-3", "2.5", "1e9", "foo", "bar", "4KiB", "1h30m", "50%" };
+
+template<typename T, size_t N>
+static size_t array_size(T (&)[N]) { return N; }
+
+static string text(Input& in, size_t max_words) {
+  string s;
+  for (size_t n = in.next() % (max_words + 1); n > 0; --n)
+    s += words[in.next() % array_size(words)];
+  return s;
+}
+
+static void add_options(Input& in, OptionContainer& c, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    vector<string> names;
+    uint8_t b = in.next();
+    if (b & 1)
+      names.push_back(string("-") + short_names[in.next() % (array_size(short_names) - 1)]);
+    if (b & 2 or names.empty()) {
+      string name;
+      for (size_t len = 1 + in.next() % 6; len > 0; --len)
+        name += long_chars[in.next() % (array_size(long_chars) - 1)];
+      names.push_back("--" + name);
+    }
+    Option& option = c.add_option(names);
+    option.action(actions[in.next() % array_size(actions)]);
+    const char* type = types[in.next() % array_size(types)];
+    if (option.nargs() == 1 and *type) {
+      option.type(type);
+      if (option.type() == "choice") {
+        vector<string> choices(values, values + 1 + in.next() % (array_size(values) - 1));
+        option.choices(choices.begin(), choices.end());
+      }
+    }
+    b = in.next();
+    if (b & 1)
+      option.set_default(values[in.next() % array_size(values)]);
+    if (b & 2)
+      option.set_const(values[in.next() % array_size(values)]);
+    if (b & 4)
+      option.metavar("VALUE");
+    option.help(text(in, 12));
+  }
+}
+
+//! A generated schema and command line, the command line can be repeated
+class Case {
+  public:
+    Case(const uint8_t* data, size_t size) : _schema(), _args() {
+      Input in(data, size);
+      size_t options = in.next() % 32;
+      size_t groups = in.next() % 3;
+      size_t schema_bytes = 2 + (options + groups) * 24;
+      const uint8_t* split = data + min(size, schema_bytes);
+      _schema.assign(data, split);
+      // arguments are separated by zero bytes
+      string arg;
+      for (const uint8_t* p = split; p != data + size; ++p) {
+        if (*p == 0) {
+          _args.push_back(arg);
+          arg.clear();
+        } else
+          arg += static_cast<char>(*p);
+      }
+      if (arg != "")
+        _args.push_back(arg);
+    }
+
+    void run(size_t repeat) const {
+      Input in(_schema.empty() ? 0 : &_schema[0], _schema.size());
+      size_t options = in.next() % 32;
+      size_t groups = in.next() % 3;
+
+      OptionParser parser;
+      parser.prog("testfuzz").add_help_option(false).add_version_option(false);
+      parser.usage(text(in, 4)).description(text(in, 40)).epilog(text(in, 8));
+      if (in.next() & 1)
+        parser.disable_interspersed_args();
+      add_options(in, parser, options);
+      list<OptionGroup> group_list;
+      for (size_t i = 0; i < groups; ++i) {
+        group_list.push_back(OptionGroup(parser, text(in, 3), text(in, 20)));
+        add_options(in, group_list.back(), 1 + in.next() % 4);
+        parser.add_option_group(group_list.back());
+      }
+
+      vector<string> args;
+      for (size_t i = 0; i < repeat; ++i)
+        args.insert(args.end(), _args.begin(), _args.end());
+      try {
+        parser.parse_args(args);
+      } catch (int) {
+      }
+      parser.format_help();
+    }
+
+  private:
+    vector<uint8_t> _schema;
+    vector<string> _args;
+};
+
+//! Discards error messages
+class NullBuf : public streambuf {
+  protected:
+    int overflow(int c) { return traits_type::not_eof(c); }
+};
+
+static void quiet() {
+  static NullBuf null;
+  cerr.rdbuf(&null);
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  quiet();
+  Case(data, size).run(1);
+  return 0;
+}
+
+#ifndef LIBFUZZER
+
+static double seconds() {
+  return static_cast<double>(clock()) / CLOCKS_PER_SEC;
+}
+
+//! Something to run at a given scale n, the work should be proportional to n
+class Workload {
+  public:
+    virtual void run(size_t n) const = 0;
+    virtual ~Workload() {}
+};
+
+class CaseWorkload : public Workload {
+  public:
+    CaseWorkload(const Case& c) : _case(c) {}
+    void run(size_t n) const { _case.run(n); }
+  private:
+    const Case& _case;
+};
+
+// -abcdefg... with one flag per character
+class ClusteredFlags : public Workload {
+  public:
+    void run(size_t n) const {
+      OptionParser parser;
+      parser.add_help_option(false);
+      const char flags[] = "abcdefghijklmnopqrstuvwxyz";
+      for (const char* f = flags; *f; ++f)
+        parser.add_option(string("-") + *f).action(*f == 'c' ? "count" : "store_true");
+      string arg = "-";
+      for (size_t i = 0; i < n; ++i)
+        arg += flags[i % 26];
+      parser.parse_args(vector<string>(1, arg));
+    }
+};
+
+// many long options, each given abbreviated on the command line
+class LongOptions : public Workload {
+  public:
+    void run(size_t n) const {
+      OptionParser parser;
+      parser.add_help_option(false);
+      vector<string> args;
+      for (size_t i = 0; i < n; ++i) {
+        stringstream ss;
+        ss << "option-" << i << "-with-a-long-name";
+        parser.add_option("--" + ss.str());
+        args.push_back("--" + ss.str().substr(0, ss.str().length() - 4) + "=x");
+      }
+      parser.parse_args(args);
+    }
+};
+
+// a help text with n words, many of them %default
+class HelpText : public Workload {
+  public:
+    void run(size_t n) const {
+      OptionParser parser;
+      parser.add_help_option(false);
+      string help;
+      for (size_t i = 0; i < n; ++i)
+        help += (i % 2) ? "%default " : "lorem-ipsum ";
+      parser.add_option("--x").set_default("dolor-sit-amet").help(help);
+      parser.description(help);
+      parser.format_help();
+    }
+};
+
+// many arguments for an append option
+class AppendValues : public Workload {
+  public:
+    void run(size_t n) const {
+      OptionParser parser;
+      parser.add_help_option(false);
+      parser.add_option("-a").action("append");
+      vector<string> args;
+      for (size_t i = 0; i < n; ++i) {
+        args.push_back("-a");
+        args.push_back("value");
+      }
+      parser.parse_args(args);
+    }
+};
+
+// average time of w.run(n), repeated until the clock is precise enough
+static double time_per_run(const Workload& w, size_t n) {
+  w.run(n);
+  size_t runs = 0;
+  double start = seconds(), elapsed = 0;
+  while (elapsed < 0.05) {
+    w.run(n);
+    ++runs;
+    elapsed = seconds() - start;
+  }
+  return elapsed / runs;
+}
+
+// linear work gives a ratio of about factor, allow for a log factor and noise
+static bool check_scaling(const string& name, const Workload& w, size_t n, size_t factor) {
+  double t1 = time_per_run(w, n);
+  double t2 = time_per_run(w, n * factor);
+  double ratio = t2 / t1;
+  bool bad = ratio > 3.0 * factor;
+  printf("%-40s n=%-6lu %10.1fus  n=%-7lu %10.1fus  x%.1f%s\n", name.c_str(),
+      static_cast<unsigned long>(n), t1 * 1e6, static_cast<unsigned long>(n * factor), t2 * 1e6, ratio,
+      bad ? "  SUPER-LINEAR" : "");
+  return not bad;
+}
+
+static string read_file(const char* name) {
+  ifstream in(name, ios::in | ios::binary);
+  stringstream ss;
+  ss << in.rdbuf();
+  return ss.str();
+}
+
+// xorshift, so that runs are reproducible everywhere
+static unsigned long long rng_state = 88172645463325252ULL;
+static uint8_t random_byte() {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return static_cast<uint8_t>(rng_state >> 32);
+}
+
+struct Timing {
+  Timing(double t, const vector<uint8_t>& d) : time(t), data(d) {}
+  bool operator< (const Timing& other) const { return time > other.time; }
+  double time;
+  vector<uint8_t> data;
+};
+
+int main(int argc, char* argv[])
+{
+  size_t runs = 2000;
+  bool latency = false;
+  vector<const char*> files;
+  for (int i = 1; i < argc; ++i) {
+    if (strncmp(argv[i], "-runs=", 6) == 0)
+      runs = strtoul(argv[i] + 6, 0, 10);
+    else if (strncmp(argv[i], "-seed=", 6) == 0)
+      rng_state = strtoull(argv[i] + 6, 0, 10) | 1;
+    else if (strcmp(argv[i], "-latency") == 0)
+      latency = true;
+    else
+      files.push_back(argv[i]);
+  }
+  quiet();
+
+  if (not files.empty()) {
+    for (vector<const char*>::const_iterator it = files.begin(); it != files.end(); ++it) {
+      string data = read_file(*it);
+      double start = seconds();
+      LLVMFuzzerTestOneInput(reinterpret_cast<const uint8_t*>(data.data()), data.size());
+      printf("%s: %lu bytes, %.1fus\n", *it, static_cast<unsigned long>(data.size()), (seconds() - start) * 1e6);
+    }
+    return 0;
+  }
+
+  // keep the slowest inputs
+  const size_t keep = 5;
+  vector<Timing> slowest;
+  for (size_t r = 0; r < runs; ++r) {
+    vector<uint8_t> data(random_byte() * 4);
+    for (size_t i = 0; i < data.size(); ++i)
+      data[i] = random_byte();
+    // mostly printable arguments with a leading dash, which reach the option handling
+    for (size_t i = 64; i < data.size(); ++i) {
+      if (data[i] % 8 == 0)
+        data[i] = 0;
+      else if (data[i] % 8 == 1)
+        data[i] = '-';
+      else
+        data[i] = short_names[data[i] % (sizeof(short_names) - 1)];
+    }
+    double start = seconds();
+    LLVMFuzzerTestOneInput(data.empty() ? 0 : &data[0], data.size());
+    slowest.push_back(Timing(seconds() - start, data));
+    sort(slowest.begin(), slowest.end());
+    if (slowest.size() > keep)
+      slowest.pop_back();
+  }
+  printf("%lu generated inputs, slowest %.1fus\n", static_cast<unsigned long>(runs),
+      slowest.empty() ? 0.0 : slowest[0].time * 1e6);
+
+  bool ok = true;
+  for (size_t i = 0; i < slowest.size(); ++i) {
+    Case c(slowest[i].data.empty() ? 0 : &slowest[i].data[0], slowest[i].data.size());
+    stringstream name;
+    name << "generated input #" << i + 1 << " (" << slowest[i].data.size() << " bytes)";
+    ok = check_scaling(name.str(), CaseWorkload(c), 1, 16) and ok;
+  }
+  ok = check_scaling("clustered short flags", ClusteredFlags(), 5000, 8) and ok;
+  ok = check_scaling("abbreviated long options", LongOptions(), 200, 8) and ok;
+  ok = check_scaling("help text with %default", HelpText(), 2000, 8) and ok;
+  ok = check_scaling("append values", AppendValues(), 1000, 8) and ok;
+  if (not ok and not latency)
+    printf("super-linear cost is only an error with -latency\n");
+  return (ok or not latency) ? 0 : 1;
+}
+
+#endif